@@ -0,0 +1,234 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "bitrank.h"
+#include "cpu.h"
+#include <stdlib.h>
+
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#define BITRANK_BLOCK_WORDS  8  /* 512 bits */
+#define BITRANK_SUPER_BLOCKS 128 /* 65536 bits */
+#define BITRANK_SAMPLE_RATE  8192
+
+static size_t bitrank_rank_generic(const bitrank_t *r, size_t i);
+static size_t bitrank_select_generic(const bitrank_t *r, size_t k);
+
+/* Query bodies are shared by the portable and the POPCNT/BMI2 variants;
+ * the compiler inlines them into each so __builtin_popcountll picks up
+ * the instruction set of the caller. */
+static inline size_t
+bitrank_block_rank(const bitrank_t *r, size_t b)
+{
+	return (size_t)r->super[b / BITRANK_SUPER_BLOCKS] + r->block[b];
+}
+
+static inline size_t
+bitrank_rank_impl(const bitrank_t *r, size_t i)
+{
+	if (i >= r->bs->length)
+		return r->ones;
+
+	size_t w = i / 64;
+	size_t b = w / BITRANK_BLOCK_WORDS;
+	size_t rank = bitrank_block_rank(r, b);
+	const uint64_t *words = r->bs->data;
+
+	for (size_t k = b * BITRANK_BLOCK_WORDS; k < w; k++)
+		rank += (size_t)__builtin_popcountll(words[k]);
+	if (i % 64)
+		rank += (size_t)__builtin_popcountll(words[w] << (64 - i % 64));
+	return rank;
+}
+
+/* Position of set bit number k (k < popcount(w)) inside one word */
+static inline unsigned
+bitrank_select64_generic(uint64_t w, unsigned k)
+{
+	unsigned shift = 0;
+	for (;;)
+	{
+		unsigned c = (unsigned)__builtin_popcountll(w & 0xff);
+		if (k < c)
+			break;
+		k -= c;
+		w >>= 8;
+		shift += 8;
+	}
+	while (k--)
+		w &= w - 1;
+	return shift + (unsigned)__builtin_ctzll(w);
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+NOSHIRO_TARGET("bmi,bmi2")
+static inline unsigned
+bitrank_select64_bmi2(uint64_t w, unsigned k)
+{
+	return (unsigned)__builtin_ctzll(_pdep_u64((uint64_t)1 << k, w));
+}
+#endif
+
+static inline size_t
+bitrank_select_impl(const bitrank_t *r,
+		    size_t k,
+		    unsigned (*select64)(uint64_t, unsigned))
+{
+	if (k >= r->ones)
+		return BITSET_NPOS;
+
+	/* The samples bracket the blocks that can hold bit k */
+	size_t s = k / BITRANK_SAMPLE_RATE;
+	size_t lo = r->samples[s];
+	size_t hi = s + 1 < r->nsamples ? r->samples[s + 1] + 1 : r->nblocks;
+	while (hi - lo > 1)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (bitrank_block_rank(r, mid) <= k)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	k -= bitrank_block_rank(r, lo);
+	const uint64_t *words = r->bs->data;
+	size_t w = lo * BITRANK_BLOCK_WORDS;
+	for (;;)
+	{
+		size_t c = (size_t)__builtin_popcountll(words[w]);
+		if (k < c)
+			break;
+		k -= c;
+		w++;
+	}
+
+	return w * 64 + select64(words[w], (unsigned)k);
+}
+
+bitrank_t *
+bitrank_new(const bitset_t *bs)
+{
+	bitrank_t *r = (bitrank_t *)calloc(1, sizeof(bitrank_t));
+	if (r == NULL)
+		return NULL;
+
+	size_t nwords = BITSET_WORDS(bs->length);
+	r->bs = bs;
+	r->nblocks = (nwords + BITRANK_BLOCK_WORDS - 1) / BITRANK_BLOCK_WORDS;
+	r->ones = bitset_count(bs);
+	r->nsamples = (r->ones + BITRANK_SAMPLE_RATE - 1) / BITRANK_SAMPLE_RATE;
+
+	size_t nsuper = (r->nblocks + BITRANK_SUPER_BLOCKS - 1) / BITRANK_SUPER_BLOCKS;
+	r->super = (uint64_t *)malloc((nsuper + 1) * sizeof(uint64_t));
+	r->block = (uint16_t *)malloc((r->nblocks + 1) * sizeof(uint16_t));
+	r->samples = (size_t *)malloc((r->nsamples + 1) * sizeof(size_t));
+	if (r->super == NULL || r->block == NULL || r->samples == NULL)
+	{
+		bitrank_free(r);
+		return NULL;
+	}
+
+	size_t total = 0, next_sample = 0;
+	for (size_t b = 0; b < r->nblocks; b++)
+	{
+		if (b % BITRANK_SUPER_BLOCKS == 0)
+			r->super[b / BITRANK_SUPER_BLOCKS] = total;
+		r->block[b] = (uint16_t)(total - r->super[b / BITRANK_SUPER_BLOCKS]);
+
+		size_t end = (b + 1) * BITRANK_BLOCK_WORDS;
+		if (end > nwords)
+			end = nwords;
+		for (size_t w = b * BITRANK_BLOCK_WORDS; w < end; w++)
+			total += (size_t)__builtin_popcountll(bs->data[w]);
+
+		/* Blocks where set bit number next_sample * 8192 falls */
+		while (next_sample < r->nsamples &&
+		       next_sample * BITRANK_SAMPLE_RATE < total)
+			r->samples[next_sample++] = b;
+	}
+
+	return r;
+}
+
+void
+bitrank_free(bitrank_t *r)
+{
+	if (r == NULL)
+		return;
+
+	free(r->super);
+	free(r->block);
+	free(r->samples);
+	free(r);
+}
+
+static size_t
+bitrank_rank_generic(const bitrank_t *r, size_t i)
+{
+	return bitrank_rank_impl(r, i);
+}
+
+static size_t
+bitrank_select_generic(const bitrank_t *r, size_t k)
+{
+	return bitrank_select_impl(r, k, bitrank_select64_generic);
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+NOSHIRO_TARGET("popcnt")
+static size_t
+bitrank_rank_popcnt(const bitrank_t *r, size_t i)
+{
+	return bitrank_rank_impl(r, i);
+}
+
+NOSHIRO_TARGET("popcnt,bmi,bmi2")
+static size_t
+bitrank_select_bmi2(const bitrank_t *r, size_t k)
+{
+	return bitrank_select_impl(r, k, bitrank_select64_bmi2);
+}
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+size_t
+bitrank_rank(const bitrank_t *r, size_t i)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("popcnt"))
+		return bitrank_rank_popcnt(r, i);
+#endif
+	return bitrank_rank_generic(r, i);
+}
+
+size_t
+bitrank_select(const bitrank_t *r, size_t k)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("bmi2") && cpu_supports("popcnt"))
+		return bitrank_select_bmi2(r, k);
+#endif
+	return bitrank_select_generic(r, k);
+}
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_BITRANK_H__
+#define __NOSHIRO_BITRANK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+/*
+ * Rank/select index over an immutable bitset_t.
+ *
+ * The index stores the number of set bits before every 512-bit block
+ * (16 bits, relative to a 65536-bit superblock that keeps a 64-bit
+ * absolute count) plus the block of every 8192nd set bit. That is about
+ * 3.2% of the size of the bitset. Rank is answered in constant time from
+ * the counters and at most eight word popcounts; select narrows the search
+ * to a few blocks through the samples.
+ *
+ * The bitset must not change while an index built over it is in use.
+ */
+typedef struct {
+	const bitset_t *bs;
+	size_t ones;       /* total number of set bits */
+	size_t nblocks;    /* number of 512-bit blocks */
+	size_t nsamples;   /* number of select samples */
+	uint64_t *super;   /* set bits before each superblock */
+	uint16_t *block;   /* set bits before each block, within its superblock */
+	size_t *samples;   /* block holding set bit number k * 8192 */
+} bitrank_t;
+
+bitrank_t *bitrank_new(const bitset_t *bs);
+void bitrank_free(bitrank_t *r);
+
+/**
+ * Number of set bits before position @p i, i.e. in [0, i). Positions past
+ * the end count every set bit.
+ */
+size_t bitrank_rank(const bitrank_t *r, size_t i);
+
+/**
+ * Position of set bit number @p k, counting from 0, so that
+ * bitrank_rank(r, bitrank_select(r, k)) == k.
+ *
+ * @return the position, or BITSET_NPOS if there are not k + 1 set bits
+ */
+size_t bitrank_select(const bitrank_t *r, size_t k);
+
+#endif /* __NOSHIRO_BITRANK_H__ */
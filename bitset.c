@@ -21,29 +21,78 @@
  */
 
 #include "bitset.h"
+#include "cpu.h"
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#define bitset_word(index) ((index) / BITSET_WORD_BITS)
+#define bitset_mask(index) ((uint64_t)1 << ((index) % BITSET_WORD_BITS))
+
+#define BITSET_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static void bitset_trim(bitset_t *bs);
+static bitset_t *bitset_new_like(const bitset_t *a, const bitset_t *b);
+static void bitset_copy_tail(bitset_t *out, const bitset_t *src, size_t from);
+static size_t bitset_popcount(const uint64_t *words, size_t n);
+static size_t bitset_tail_count(const bitset_t *bs, size_t from);
+static bool bitset_range_masks(const bitset_t *bs,
+			       size_t begin,
+			       size_t *end,
+			       uint64_t *first,
+			       uint64_t *last);
+
+#define BITSET_DECLARE_KERNELS(name) \
+	static void bitset_##name##_words( \
+	    uint64_t *d, const uint64_t *a, const uint64_t *b, size_t n); \
+	static size_t bitset_##name##_count_words( \
+	    const uint64_t *a, const uint64_t *b, size_t n);
+
+BITSET_DECLARE_KERNELS(and)
+BITSET_DECLARE_KERNELS(or)
+BITSET_DECLARE_KERNELS(xor)
+BITSET_DECLARE_KERNELS(andnot)
+static bool bitset_intersects_words(const uint64_t *a, const uint64_t *b, size_t n);
+static size_t bitset_extract_generic(const uint64_t *words,
+				     size_t i,
+				     size_t n,
+				     uint64_t w,
+				     uint32_t *out,
+				     size_t max);
+#ifdef NOSHIRO_X86_DISPATCH
+static size_t bitset_extract_avx2(const uint64_t *words,
+				  size_t i,
+				  size_t n,
+				  uint64_t w,
+				  uint32_t *out,
+				  size_t max);
+#endif
+
 /// @brief Create a new bitset.
 /// @param size The size of the bitset.
-/// @return Generate an 8-bit aligned bitset
+/// @return Generate a 64-bit aligned bitset
 bitset_t *
 bitset_new(size_t size)
 {
 	size_t cap = 0;
 	if (size == 0)
-		cap = 8;
+		cap = BITSET_WORD_BITS;
 	else
 	{
-		cap = (size + 7) & ~7; // round up to multiple of 8
+		// round up to a whole number of words
+		cap = BITSET_WORDS(size) * BITSET_WORD_BITS;
 	}
 
-	bitset_t *bs = (bitset_t *)malloc(sizeof(bitset_t) + cap / 8);
+	size_t bytes = sizeof(bitset_t) + cap / 8;
+	bitset_t *bs = (bitset_t *)malloc(bytes);
 	if (bs == NULL)
 	{
 		return NULL;
 	}
-	memset(bs, 0, sizeof(bitset_t) + cap / 8);
+	memset(bs, 0, bytes);
 	bs->length = size;
 	bs->capacity = cap;
 	return bs;
@@ -69,7 +118,7 @@ bitset_set(bitset_t *bs, size_t index)
 		return;
 	}
 
-	bs->data[index / 8] |= (1 << (index % 8)); // set bit
+	bs->data[bitset_word(index)] |= bitset_mask(index); // set bit
 }
 
 /// @brief Clear the \a index bit to LW_FALSE
@@ -84,21 +133,21 @@ bitset_clear(bitset_t *bs, size_t index)
 		return;
 	}
 
-	bs->data[index / 8] &= ~(1 << (index % 8)); // clear bit
+	bs->data[bitset_word(index)] &= ~bitset_mask(index); // clear bit
 }
 
 /// @brief Test if the \a index bit is LW_TRUE or LW_FALSE
 /// @param bs The bitset
 /// @param index The index of the bit
 bool
-bitset_test(bitset_t *bs, size_t index)
+bitset_test(const bitset_t *bs, size_t index)
 {
 	if (index >= bs->length)
 	{
 		return false;
 	}
 
-	return bs->data[index / 8] & (char)(1 << (index % 8)); // test bit
+	return (bs->data[bitset_word(index)] & bitset_mask(index)) != 0;
 }
 
 /// @brief Flip the \a index bit
@@ -113,54 +162,1174 @@ bitset_flip(bitset_t *bs, size_t index)
 		return;
 	}
 
-	bs->data[index / 8] ^= (1 << (index % 8));
+	bs->data[bitset_word(index)] ^= bitset_mask(index);
 }
 
 /// @brief Get the state of the bitset
 /// @param bs The bitset
 /// @return The return value is a BITSET_STATE_* series macro
+/// @note Stops at the first word that holds both set and clear bits
 int
-bitset_state(bitset_t *bs)
+bitset_state(const bitset_t *bs)
 {
-	size_t c = bitset_count(bs);
-	if (c == 0)
+	size_t full = bs->length / BITSET_WORD_BITS;
+	size_t rem = bs->length % BITSET_WORD_BITS;
+	bool any = false, all = true;
+
+	for (size_t i = 0; i < full; i++)
+	{
+		uint64_t w = bs->data[i];
+		any |= w != 0;
+		all &= w == ~(uint64_t)0;
+		if (any && !all)
+		{
+			return BITSET_STATE_ANY;
+		}
+	}
+
+	if (rem)
+	{
+		uint64_t w = bs->data[full];
+		any |= w != 0;
+		all &= w == ((uint64_t)1 << rem) - 1;
+	}
+
+	if (!any)
 	{
 		return BITSET_STATE_NONE;
 	}
-	else if (c == bs->length)
+	return all ? BITSET_STATE_ALL : BITSET_STATE_ANY;
+}
+
+/// @brief Test if at least one bit is LW_TRUE
+/// @param bs The bitset
+/// @return Stops at the first non-zero word
+bool
+bitset_any(const bitset_t *bs)
+{
+	size_t n = BITSET_WORDS(bs->length);
+	for (size_t i = 0; i < n; i++)
 	{
-		return BITSET_STATE_ALL;
+		if (bs->data[i])
+		{
+			return true;
+		}
 	}
-	else
+	return false;
+}
+
+/// @brief Test if every bit is LW_TRUE
+/// @param bs The bitset
+/// @return Stops at the first word with a clear bit
+bool
+bitset_all(const bitset_t *bs)
+{
+	size_t full = bs->length / BITSET_WORD_BITS;
+	size_t rem = bs->length % BITSET_WORD_BITS;
+
+	for (size_t i = 0; i < full; i++)
 	{
-		return BITSET_STATE_ANY;
+		if (bs->data[i] != ~(uint64_t)0)
+		{
+			return false;
+		}
 	}
+	return rem == 0 || bs->data[full] == ((uint64_t)1 << rem) - 1;
+}
+
+/// @brief Test if every bit is LW_FALSE
+/// @param bs The bitset
+bool
+bitset_none(const bitset_t *bs)
+{
+	return !bitset_any(bs);
 }
 
 /// @brief Count the number of bits set to LW_TRUE
 /// @param bs The bitset
 /// @return The number of bits set to LW_TRUE
 size_t
-bitset_count(bitset_t *bs)
+bitset_count(const bitset_t *bs)
 {
-	int count = 0;
-	for (int i = 0; i < (bs->length / 8) + (bs->length % 8 ? 1 : 0); i++)
+	return bitset_popcount(bs->data, BITSET_WORDS(bs->length));
+}
+
+/// @brief Get the size of the bitset
+/// @param bs The bitset
+/// @return The number of bits
+size_t
+bitset_size(const bitset_t *bs)
+{
+	return bs->length;
+}
+
+/// @brief Change the number of bits
+/// @param bs The bitset
+/// @param size The new number of bits
+/// @return The resized bitset, which may have moved, or NULL on allocation
+///         failure in which case \a bs is still valid
+bitset_t *
+bitset_resize(bitset_t *bs, size_t size)
+{
+	size_t old_words = BITSET_WORDS(bs->length);
+	size_t new_words = BITSET_WORDS(size);
+
+	if (size <= bs->length)
+	{
+		// keep every word past the end zero so later growth reads LW_FALSE
+		if (old_words > new_words)
+		{
+			memset(bs->data + new_words, 0, (old_words - new_words) * sizeof(uint64_t));
+		}
+		bs->length = size;
+		bitset_trim(bs);
+		return bs;
+	}
+
+	if (size > bs->capacity)
 	{
-		unsigned char byte = bs->data[i];
-		while (byte)
+		size_t cap = bs->capacity * 2;
+		if (cap < size)
+		{
+			cap = size;
+		}
+		cap = BITSET_WORDS(cap) * BITSET_WORD_BITS;
+
+		bitset_t *grown = (bitset_t *)realloc(bs, sizeof(bitset_t) + cap / 8);
+		if (grown == NULL)
 		{
-			byte &= (byte - 1);
-			count++;
+			return NULL;
 		}
+		bs = grown;
+		memset(bs->data + bs->capacity / BITSET_WORD_BITS, 0,
+		       (cap - bs->capacity) / 8);
+		bs->capacity = cap;
 	}
-	return count;
+
+	bs->length = size;
+	return bs;
 }
 
-/// @brief Get the size of the bitset
+/// @brief Set the bits in [begin, end) to LW_TRUE
 /// @param bs The bitset
-/// @return An 8-bit aligned value
+/// @param begin The first index
+/// @param end One past the last index
+void
+bitset_set_range(bitset_t *bs, size_t begin, size_t end)
+{
+	uint64_t first, last;
+	if (!bitset_range_masks(bs, begin, &end, &first, &last))
+	{
+		return;
+	}
+
+	size_t i = bitset_word(begin);
+	size_t j = bitset_word(end - 1);
+	if (i == j)
+	{
+		bs->data[i] |= first & last;
+		return;
+	}
+	bs->data[i] |= first;
+	memset(bs->data + i + 1, 0xff, (j - i - 1) * sizeof(uint64_t));
+	bs->data[j] |= last;
+}
+
+/// @brief Clear the bits in [begin, end) to LW_FALSE
+/// @param bs The bitset
+/// @param begin The first index
+/// @param end One past the last index
+void
+bitset_clear_range(bitset_t *bs, size_t begin, size_t end)
+{
+	uint64_t first, last;
+	if (!bitset_range_masks(bs, begin, &end, &first, &last))
+	{
+		return;
+	}
+
+	size_t i = bitset_word(begin);
+	size_t j = bitset_word(end - 1);
+	if (i == j)
+	{
+		bs->data[i] &= ~(first & last);
+		return;
+	}
+	bs->data[i] &= ~first;
+	memset(bs->data + i + 1, 0, (j - i - 1) * sizeof(uint64_t));
+	bs->data[j] &= ~last;
+}
+
+/// @brief Count the LW_TRUE bits in [begin, end)
+/// @param bs The bitset
+/// @param begin The first index
+/// @param end One past the last index
+/// @return The number of bits set
 size_t
-bitset_size(bitset_t *bs)
+bitset_count_range(const bitset_t *bs, size_t begin, size_t end)
 {
-	return bs->length;
-}
\ No newline at end of file
+	uint64_t first, last;
+	if (!bitset_range_masks(bs, begin, &end, &first, &last))
+	{
+		return 0;
+	}
+
+	size_t i = bitset_word(begin);
+	size_t j = bitset_word(end - 1);
+	if (i == j)
+	{
+		return (size_t)__builtin_popcountll(bs->data[i] & first & last);
+	}
+	return (size_t)__builtin_popcountll(bs->data[i] & first) +
+	       bitset_popcount(bs->data + i + 1, j - i - 1) +
+	       (size_t)__builtin_popcountll(bs->data[j] & last);
+}
+
+/// @brief Check if any bit in [begin, end) is LW_TRUE
+/// @param bs The bitset
+/// @param begin The first index
+/// @param end One past the last index
+/// @return true if at least one bit is set
+bool
+bitset_any_range(const bitset_t *bs, size_t begin, size_t end)
+{
+	uint64_t first, last;
+	if (!bitset_range_masks(bs, begin, &end, &first, &last))
+	{
+		return false;
+	}
+
+	size_t i = bitset_word(begin);
+	size_t j = bitset_word(end - 1);
+	if (i == j)
+	{
+		return (bs->data[i] & first & last) != 0;
+	}
+	if (bs->data[i] & first || bs->data[j] & last)
+	{
+		return true;
+	}
+	for (size_t k = i + 1; k < j; k++)
+	{
+		if (bs->data[k])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/// @brief dst &= src. Bits past the end of \a src count as LW_FALSE.
+/// @param dst The bitset to update
+/// @param src The other operand
+void
+bitset_and(bitset_t *dst, const bitset_t *src)
+{
+	size_t nd = BITSET_WORDS(dst->length);
+	size_t n = BITSET_MIN(nd, BITSET_WORDS(src->length));
+
+	bitset_and_words(dst->data, dst->data, src->data, n);
+	if (nd > n)
+	{
+		memset(dst->data + n, 0, (nd - n) * sizeof(uint64_t));
+	}
+}
+
+/// @brief dst |= src. Bits of \a src past the end of \a dst are ignored.
+/// @param dst The bitset to update
+/// @param src The other operand
+void
+bitset_or(bitset_t *dst, const bitset_t *src)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(dst->length), BITSET_WORDS(src->length));
+
+	bitset_or_words(dst->data, dst->data, src->data, n);
+	bitset_trim(dst);
+}
+
+/// @brief dst ^= src. Bits of \a src past the end of \a dst are ignored.
+/// @param dst The bitset to update
+/// @param src The other operand
+void
+bitset_xor(bitset_t *dst, const bitset_t *src)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(dst->length), BITSET_WORDS(src->length));
+
+	bitset_xor_words(dst->data, dst->data, src->data, n);
+	bitset_trim(dst);
+}
+
+/// @brief dst &= ~src, i.e. remove the bits of \a src from \a dst
+/// @param dst The bitset to update
+/// @param src The other operand
+void
+bitset_andnot(bitset_t *dst, const bitset_t *src)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(dst->length), BITSET_WORDS(src->length));
+
+	bitset_andnot_words(dst->data, dst->data, src->data, n);
+}
+
+/// @brief Create a new bitset holding a & b
+/// @return A bitset as long as the longer operand, or NULL on failure
+bitset_t *
+bitset_and_new(const bitset_t *a, const bitset_t *b)
+{
+	bitset_t *out = bitset_new_like(a, b);
+	if (out == NULL)
+	{
+		return NULL;
+	}
+
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	bitset_and_words(out->data, a->data, b->data, n);
+	return out;
+}
+
+/// @brief Create a new bitset holding a | b
+/// @return A bitset as long as the longer operand, or NULL on failure
+bitset_t *
+bitset_or_new(const bitset_t *a, const bitset_t *b)
+{
+	bitset_t *out = bitset_new_like(a, b);
+	if (out == NULL)
+	{
+		return NULL;
+	}
+
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	bitset_or_words(out->data, a->data, b->data, n);
+	bitset_copy_tail(out, a->length > b->length ? a : b, n);
+	return out;
+}
+
+/// @brief Create a new bitset holding a ^ b
+/// @return A bitset as long as the longer operand, or NULL on failure
+bitset_t *
+bitset_xor_new(const bitset_t *a, const bitset_t *b)
+{
+	bitset_t *out = bitset_new_like(a, b);
+	if (out == NULL)
+	{
+		return NULL;
+	}
+
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	bitset_xor_words(out->data, a->data, b->data, n);
+	bitset_copy_tail(out, a->length > b->length ? a : b, n);
+	return out;
+}
+
+/// @brief Create a new bitset holding a & ~b
+/// @return A bitset as long as the longer operand, or NULL on failure
+bitset_t *
+bitset_andnot_new(const bitset_t *a, const bitset_t *b)
+{
+	bitset_t *out = bitset_new_like(a, b);
+	if (out == NULL)
+	{
+		return NULL;
+	}
+
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	bitset_andnot_words(out->data, a->data, b->data, n);
+	bitset_copy_tail(out, a, n);
+	return out;
+}
+
+/// @brief Count the bits of a & b without building it
+size_t
+bitset_and_count(const bitset_t *a, const bitset_t *b)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	return bitset_and_count_words(a->data, b->data, n);
+}
+
+/// @brief Count the bits of a | b without building it
+size_t
+bitset_or_count(const bitset_t *a, const bitset_t *b)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	return bitset_or_count_words(a->data, b->data, n) +
+	       bitset_tail_count(a->length > b->length ? a : b, n);
+}
+
+/// @brief Count the bits of a ^ b without building it
+size_t
+bitset_xor_count(const bitset_t *a, const bitset_t *b)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	return bitset_xor_count_words(a->data, b->data, n) +
+	       bitset_tail_count(a->length > b->length ? a : b, n);
+}
+
+/// @brief Count the bits of a & ~b without building it
+size_t
+bitset_andnot_count(const bitset_t *a, const bitset_t *b)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	return bitset_andnot_count_words(a->data, b->data, n) +
+	       bitset_tail_count(a, n);
+}
+
+/// @brief Test if \a a and \a b have at least one bit in common
+/// @return Stops at the first common word
+bool
+bitset_intersects(const bitset_t *a, const bitset_t *b)
+{
+	size_t n = BITSET_MIN(BITSET_WORDS(a->length), BITSET_WORDS(b->length));
+	return bitset_intersects_words(a->data, b->data, n);
+}
+
+/// @brief Find the first LW_TRUE bit at or after \a from
+/// @param bs The bitset
+/// @param from The index to start from
+/// @return The index of the bit, or BITSET_NPOS if there is none
+size_t
+bitset_next_set(const bitset_t *bs, size_t from)
+{
+	if (from >= bs->length)
+	{
+		return BITSET_NPOS;
+	}
+
+	size_t i = bitset_word(from);
+	size_t n = BITSET_WORDS(bs->length);
+	uint64_t w = bs->data[i] & (~(uint64_t)0 << (from % BITSET_WORD_BITS));
+
+	while (w == 0)
+	{
+		if (++i == n)
+		{
+			return BITSET_NPOS;
+		}
+		w = bs->data[i];
+	}
+	return i * BITSET_WORD_BITS + (size_t)__builtin_ctzll(w);
+}
+
+/// @brief Find the first LW_FALSE bit at or after \a from
+/// @param bs The bitset
+/// @param from The index to start from
+/// @return The index of the bit, or BITSET_NPOS if there is none
+size_t
+bitset_next_clear(const bitset_t *bs, size_t from)
+{
+	if (from >= bs->length)
+	{
+		return BITSET_NPOS;
+	}
+
+	size_t i = bitset_word(from);
+	size_t n = BITSET_WORDS(bs->length);
+	uint64_t w = ~bs->data[i] & (~(uint64_t)0 << (from % BITSET_WORD_BITS));
+
+	while (w == 0)
+	{
+		if (++i == n)
+		{
+			return BITSET_NPOS;
+		}
+		w = ~bs->data[i];
+	}
+
+	/* The zero bits past the end of the last word must not match */
+	size_t index = i * BITSET_WORD_BITS + (size_t)__builtin_ctzll(w);
+	return index < bs->length ? index : BITSET_NPOS;
+}
+
+/// @brief Find the last LW_TRUE bit at or before \a from
+/// @param bs The bitset
+/// @param from The index to start from, clamped to the last bit
+/// @return The index of the bit, or BITSET_NPOS if there is none
+size_t
+bitset_prev_set(const bitset_t *bs, size_t from)
+{
+	if (bs->length == 0)
+	{
+		return BITSET_NPOS;
+	}
+	if (from >= bs->length)
+	{
+		from = bs->length - 1;
+	}
+
+	size_t i = bitset_word(from);
+	uint64_t w = bs->data[i] &
+		     (~(uint64_t)0 >> (BITSET_WORD_BITS - 1 - from % BITSET_WORD_BITS));
+
+	while (w == 0)
+	{
+		if (i-- == 0)
+		{
+			return BITSET_NPOS;
+		}
+		w = bs->data[i];
+	}
+	return i * BITSET_WORD_BITS + BITSET_WORD_BITS - 1 -
+	       (size_t)__builtin_clzll(w);
+}
+
+/// @brief Write the indices of the LW_TRUE bits at or after \a from
+/// @param bs The bitset, at most 2^32 bits long
+/// @param from The index to start from
+/// @param out The output array
+/// @param max The capacity of \a out
+/// @return The number of indices written; when it equals \a max, resume
+///         from the last index plus one
+size_t
+bitset_extract_set(const bitset_t *bs, size_t from, uint32_t *out, size_t max)
+{
+	if (from >= bs->length || max == 0)
+	{
+		return 0;
+	}
+
+	size_t i = bitset_word(from);
+	size_t n = BITSET_WORDS(bs->length);
+	uint64_t first = bs->data[i] & (~(uint64_t)0 << (from % BITSET_WORD_BITS));
+
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+	{
+		return bitset_extract_avx2(bs->data, i, n, first, out, max);
+	}
+#endif
+	return bitset_extract_generic(bs->data, i, n, first, out, max);
+}
+
+/* Clear the bits of the last word that are past the end */
+static void
+bitset_trim(bitset_t *bs)
+{
+	size_t rem = bs->length % BITSET_WORD_BITS;
+	if (rem)
+	{
+		bs->data[bs->length / BITSET_WORD_BITS] &= ((uint64_t)1 << rem) - 1;
+	}
+}
+
+static bitset_t *
+bitset_new_like(const bitset_t *a, const bitset_t *b)
+{
+	return bitset_new(a->length > b->length ? a->length : b->length);
+}
+
+/* Copy the words of src from word `from` on; out is at least as long */
+static void
+bitset_copy_tail(bitset_t *out, const bitset_t *src, size_t from)
+{
+	size_t n = BITSET_WORDS(src->length);
+	if (n > from)
+	{
+		memcpy(out->data + from, src->data + from, (n - from) * sizeof(uint64_t));
+	}
+}
+
+static size_t
+bitset_tail_count(const bitset_t *bs, size_t from)
+{
+	size_t n = BITSET_WORDS(bs->length);
+	return n > from ? bitset_popcount(bs->data + from, n - from) : 0;
+}
+
+/* Clamp [begin, *end) to the length and build the masks selecting its
+ * bits in the first and last word; false when the range is empty */
+static bool
+bitset_range_masks(const bitset_t *bs,
+		   size_t begin,
+		   size_t *end,
+		   uint64_t *first,
+		   uint64_t *last)
+{
+	if (*end > bs->length)
+	{
+		*end = bs->length;
+	}
+	if (begin >= *end)
+	{
+		return false;
+	}
+
+	*first = ~(uint64_t)0 << (begin % BITSET_WORD_BITS);
+	*last = ~(uint64_t)0 >> (BITSET_WORD_BITS - 1 - (*end - 1) % BITSET_WORD_BITS);
+	return true;
+}
+
+/* ---------------------------- kernels ---------------------------- */
+
+/*
+ * Every binary operator gets a three-operand word kernel (d = a op b, with
+ * d allowed to alias a) and a fused "op then popcount" kernel, generated
+ * below for the portable, POPCNT, AVX2 and AVX-512 code paths.
+ */
+#define BITSET_OP_AND(x, y)    ((x) & (y))
+#define BITSET_OP_OR(x, y)     ((x) | (y))
+#define BITSET_OP_XOR(x, y)    ((x) ^ (y))
+#define BITSET_OP_ANDNOT(x, y) ((x) & ~(y))
+
+static inline size_t
+bitset_popcount64(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (size_t)((x * 0x0101010101010101ULL) >> 56);
+}
+
+#define BITSET_GENERIC_KERNELS(name, op) \
+	static void bitset_##name##_words_generic( \
+	    uint64_t *d, const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		for (size_t i = 0; i < n; i++) \
+			d[i] = op(a[i], b[i]); \
+	} \
+	static size_t bitset_##name##_count_generic( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		size_t count = 0; \
+		for (size_t i = 0; i < n; i++) \
+			count += bitset_popcount64(op(a[i], b[i])); \
+		return count; \
+	}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+#define BITSET_V256_AND(x, y)    _mm256_and_si256((x), (y))
+#define BITSET_V256_OR(x, y)     _mm256_or_si256((x), (y))
+#define BITSET_V256_XOR(x, y)    _mm256_xor_si256((x), (y))
+#define BITSET_V256_ANDNOT(x, y) _mm256_andnot_si256((y), (x))
+#define BITSET_V512_AND(x, y)    _mm512_and_si512((x), (y))
+#define BITSET_V512_OR(x, y)     _mm512_or_si512((x), (y))
+#define BITSET_V512_XOR(x, y)    _mm512_xor_si512((x), (y))
+#define BITSET_V512_ANDNOT(x, y) _mm512_andnot_si512((y), (x))
+
+#define BITSET_LOAD256(p) _mm256_loadu_si256((const __m256i *)(const void *)(p))
+
+/*
+ * The AVX2 count uses a nibble lookup with vpshufb; byte counts are summed
+ * with vpsadbw once per batch of 8 vectors, before they can overflow.
+ */
+#define BITSET_X86_KERNELS(name, op, vop256, vop512) \
+	NOSHIRO_TARGET("avx2") \
+	static void bitset_##name##_words_avx2( \
+	    uint64_t *d, const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		size_t i = 0; \
+		for (; i + 4 <= n; i += 4) \
+			_mm256_storeu_si256( \
+			    (__m256i *)(void *)(d + i), \
+			    vop256(BITSET_LOAD256(a + i), BITSET_LOAD256(b + i))); \
+		for (; i < n; i++) \
+			d[i] = op(a[i], b[i]); \
+	} \
+	NOSHIRO_TARGET("popcnt") \
+	static size_t bitset_##name##_count_popcnt( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0; \
+		size_t i = 0; \
+		for (; i + 4 <= n; i += 4) \
+		{ \
+			c0 += (uint64_t)__builtin_popcountll(op(a[i], b[i])); \
+			c1 += (uint64_t)__builtin_popcountll(op(a[i + 1], b[i + 1])); \
+			c2 += (uint64_t)__builtin_popcountll(op(a[i + 2], b[i + 2])); \
+			c3 += (uint64_t)__builtin_popcountll(op(a[i + 3], b[i + 3])); \
+		} \
+		for (; i < n; i++) \
+			c0 += (uint64_t)__builtin_popcountll(op(a[i], b[i])); \
+		return (size_t)(c0 + c1 + c2 + c3); \
+	} \
+	NOSHIRO_TARGET("avx2,popcnt") \
+	static size_t bitset_##name##_count_avx2( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, \
+							1, 2, 2, 3, 2, 3, 3, 4, \
+							0, 1, 1, 2, 1, 2, 2, 3, \
+							1, 2, 2, 3, 2, 3, 3, 4); \
+		const __m256i low = _mm256_set1_epi8(0x0f); \
+		__m256i total = _mm256_setzero_si256(); \
+		size_t i = 0; \
+		while (i + 4 <= n) \
+		{ \
+			__m256i bytes = _mm256_setzero_si256(); \
+			for (int k = 0; k < 8 && i + 4 <= n; k++, i += 4) \
+			{ \
+				__m256i v = vop256(BITSET_LOAD256(a + i), \
+						   BITSET_LOAD256(b + i)); \
+				__m256i lo = _mm256_and_si256(v, low); \
+				__m256i hi = \
+				    _mm256_and_si256(_mm256_srli_epi16(v, 4), low); \
+				bytes = _mm256_add_epi8( \
+				    bytes, _mm256_shuffle_epi8(lookup, lo)); \
+				bytes = _mm256_add_epi8( \
+				    bytes, _mm256_shuffle_epi8(lookup, hi)); \
+			} \
+			total = _mm256_add_epi64( \
+			    total, _mm256_sad_epu8(bytes, _mm256_setzero_si256())); \
+		} \
+		uint64_t lanes[4]; \
+		_mm256_storeu_si256((__m256i *)(void *)lanes, total); \
+		size_t count = (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]); \
+		for (; i < n; i++) \
+			count += (size_t)__builtin_popcountll(op(a[i], b[i])); \
+		return count; \
+	} \
+	NOSHIRO_TARGET("avx512f,avx512vpopcntdq") \
+	static size_t bitset_##name##_count_avx512( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		__m512i total = _mm512_setzero_si512(); \
+		size_t i = 0; \
+		for (; i + 8 <= n; i += 8) \
+			total = _mm512_add_epi64( \
+			    total, \
+			    _mm512_popcnt_epi64(vop512(_mm512_loadu_si512(a + i), \
+						       _mm512_loadu_si512(b + i)))); \
+		if (i < n) \
+		{ \
+			__mmask8 m = (__mmask8)((1u << (n - i)) - 1); \
+			total = _mm512_add_epi64( \
+			    total, \
+			    _mm512_popcnt_epi64( \
+				vop512(_mm512_maskz_loadu_epi64(m, a + i), \
+				       _mm512_maskz_loadu_epi64(m, b + i)))); \
+		} \
+		return (size_t)_mm512_reduce_add_epi64(total); \
+	}
+
+/* The wide kernels only pay off once a few cache lines are involved */
+#define BITSET_KERNELS(name, op, vop256, vop512) \
+	BITSET_GENERIC_KERNELS(name, op) \
+	BITSET_X86_KERNELS(name, op, vop256, vop512) \
+	static void bitset_##name##_words( \
+	    uint64_t *d, const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		if (n >= 8 && cpu_supports("avx2")) \
+			bitset_##name##_words_avx2(d, a, b, n); \
+		else \
+			bitset_##name##_words_generic(d, a, b, n); \
+	} \
+	static size_t bitset_##name##_count_words( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		if (n >= 32) \
+		{ \
+			if (cpu_supports("avx512vpopcntdq")) \
+				return bitset_##name##_count_avx512(a, b, n); \
+			if (cpu_supports("avx2")) \
+				return bitset_##name##_count_avx2(a, b, n); \
+		} \
+		if (cpu_supports("popcnt")) \
+			return bitset_##name##_count_popcnt(a, b, n); \
+		return bitset_##name##_count_generic(a, b, n); \
+	}
+
+#else /* !NOSHIRO_X86_DISPATCH */
+
+#define BITSET_KERNELS(name, op, vop256, vop512) \
+	BITSET_GENERIC_KERNELS(name, op) \
+	static void bitset_##name##_words( \
+	    uint64_t *d, const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		bitset_##name##_words_generic(d, a, b, n); \
+	} \
+	static size_t bitset_##name##_count_words( \
+	    const uint64_t *a, const uint64_t *b, size_t n) \
+	{ \
+		return bitset_##name##_count_generic(a, b, n); \
+	}
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+BITSET_KERNELS(and, BITSET_OP_AND, BITSET_V256_AND, BITSET_V512_AND)
+BITSET_KERNELS(or, BITSET_OP_OR, BITSET_V256_OR, BITSET_V512_OR)
+BITSET_KERNELS(xor, BITSET_OP_XOR, BITSET_V256_XOR, BITSET_V512_XOR)
+BITSET_KERNELS(andnot, BITSET_OP_ANDNOT, BITSET_V256_ANDNOT, BITSET_V512_ANDNOT)
+
+/* a & a == a, so the AND count kernel doubles as a plain popcount */
+static size_t
+bitset_popcount(const uint64_t *words, size_t n)
+{
+	return bitset_and_count_words(words, words, n);
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+NOSHIRO_TARGET("avx2")
+static bool
+bitset_intersects_avx2(const uint64_t *a, const uint64_t *b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		if (!_mm256_testz_si256(BITSET_LOAD256(a + i), BITSET_LOAD256(b + i)))
+			return true;
+	}
+	for (; i < n; i++)
+	{
+		if (a[i] & b[i])
+			return true;
+	}
+	return false;
+}
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+static bool
+bitset_intersects_words(const uint64_t *a, const uint64_t *b, size_t n)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (n >= 8 && cpu_supports("avx2"))
+		return bitset_intersects_avx2(a, b, n);
+#endif
+	for (size_t i = 0; i < n; i++)
+	{
+		if (a[i] & b[i])
+			return true;
+	}
+	return false;
+}
+
+/* ---------------------------- extraction ---------------------------- */
+
+/* Positions of the set bits of every byte value, padded with zeros */
+static const uint8_t bitset_decode_lut[256][8] = {
+	{0, 0, 0, 0, 0, 0, 0, 0},
+	{0, 0, 0, 0, 0, 0, 0, 0},
+	{1, 0, 0, 0, 0, 0, 0, 0},
+	{0, 1, 0, 0, 0, 0, 0, 0},
+	{2, 0, 0, 0, 0, 0, 0, 0},
+	{0, 2, 0, 0, 0, 0, 0, 0},
+	{1, 2, 0, 0, 0, 0, 0, 0},
+	{0, 1, 2, 0, 0, 0, 0, 0},
+	{3, 0, 0, 0, 0, 0, 0, 0},
+	{0, 3, 0, 0, 0, 0, 0, 0},
+	{1, 3, 0, 0, 0, 0, 0, 0},
+	{0, 1, 3, 0, 0, 0, 0, 0},
+	{2, 3, 0, 0, 0, 0, 0, 0},
+	{0, 2, 3, 0, 0, 0, 0, 0},
+	{1, 2, 3, 0, 0, 0, 0, 0},
+	{0, 1, 2, 3, 0, 0, 0, 0},
+	{4, 0, 0, 0, 0, 0, 0, 0},
+	{0, 4, 0, 0, 0, 0, 0, 0},
+	{1, 4, 0, 0, 0, 0, 0, 0},
+	{0, 1, 4, 0, 0, 0, 0, 0},
+	{2, 4, 0, 0, 0, 0, 0, 0},
+	{0, 2, 4, 0, 0, 0, 0, 0},
+	{1, 2, 4, 0, 0, 0, 0, 0},
+	{0, 1, 2, 4, 0, 0, 0, 0},
+	{3, 4, 0, 0, 0, 0, 0, 0},
+	{0, 3, 4, 0, 0, 0, 0, 0},
+	{1, 3, 4, 0, 0, 0, 0, 0},
+	{0, 1, 3, 4, 0, 0, 0, 0},
+	{2, 3, 4, 0, 0, 0, 0, 0},
+	{0, 2, 3, 4, 0, 0, 0, 0},
+	{1, 2, 3, 4, 0, 0, 0, 0},
+	{0, 1, 2, 3, 4, 0, 0, 0},
+	{5, 0, 0, 0, 0, 0, 0, 0},
+	{0, 5, 0, 0, 0, 0, 0, 0},
+	{1, 5, 0, 0, 0, 0, 0, 0},
+	{0, 1, 5, 0, 0, 0, 0, 0},
+	{2, 5, 0, 0, 0, 0, 0, 0},
+	{0, 2, 5, 0, 0, 0, 0, 0},
+	{1, 2, 5, 0, 0, 0, 0, 0},
+	{0, 1, 2, 5, 0, 0, 0, 0},
+	{3, 5, 0, 0, 0, 0, 0, 0},
+	{0, 3, 5, 0, 0, 0, 0, 0},
+	{1, 3, 5, 0, 0, 0, 0, 0},
+	{0, 1, 3, 5, 0, 0, 0, 0},
+	{2, 3, 5, 0, 0, 0, 0, 0},
+	{0, 2, 3, 5, 0, 0, 0, 0},
+	{1, 2, 3, 5, 0, 0, 0, 0},
+	{0, 1, 2, 3, 5, 0, 0, 0},
+	{4, 5, 0, 0, 0, 0, 0, 0},
+	{0, 4, 5, 0, 0, 0, 0, 0},
+	{1, 4, 5, 0, 0, 0, 0, 0},
+	{0, 1, 4, 5, 0, 0, 0, 0},
+	{2, 4, 5, 0, 0, 0, 0, 0},
+	{0, 2, 4, 5, 0, 0, 0, 0},
+	{1, 2, 4, 5, 0, 0, 0, 0},
+	{0, 1, 2, 4, 5, 0, 0, 0},
+	{3, 4, 5, 0, 0, 0, 0, 0},
+	{0, 3, 4, 5, 0, 0, 0, 0},
+	{1, 3, 4, 5, 0, 0, 0, 0},
+	{0, 1, 3, 4, 5, 0, 0, 0},
+	{2, 3, 4, 5, 0, 0, 0, 0},
+	{0, 2, 3, 4, 5, 0, 0, 0},
+	{1, 2, 3, 4, 5, 0, 0, 0},
+	{0, 1, 2, 3, 4, 5, 0, 0},
+	{6, 0, 0, 0, 0, 0, 0, 0},
+	{0, 6, 0, 0, 0, 0, 0, 0},
+	{1, 6, 0, 0, 0, 0, 0, 0},
+	{0, 1, 6, 0, 0, 0, 0, 0},
+	{2, 6, 0, 0, 0, 0, 0, 0},
+	{0, 2, 6, 0, 0, 0, 0, 0},
+	{1, 2, 6, 0, 0, 0, 0, 0},
+	{0, 1, 2, 6, 0, 0, 0, 0},
+	{3, 6, 0, 0, 0, 0, 0, 0},
+	{0, 3, 6, 0, 0, 0, 0, 0},
+	{1, 3, 6, 0, 0, 0, 0, 0},
+	{0, 1, 3, 6, 0, 0, 0, 0},
+	{2, 3, 6, 0, 0, 0, 0, 0},
+	{0, 2, 3, 6, 0, 0, 0, 0},
+	{1, 2, 3, 6, 0, 0, 0, 0},
+	{0, 1, 2, 3, 6, 0, 0, 0},
+	{4, 6, 0, 0, 0, 0, 0, 0},
+	{0, 4, 6, 0, 0, 0, 0, 0},
+	{1, 4, 6, 0, 0, 0, 0, 0},
+	{0, 1, 4, 6, 0, 0, 0, 0},
+	{2, 4, 6, 0, 0, 0, 0, 0},
+	{0, 2, 4, 6, 0, 0, 0, 0},
+	{1, 2, 4, 6, 0, 0, 0, 0},
+	{0, 1, 2, 4, 6, 0, 0, 0},
+	{3, 4, 6, 0, 0, 0, 0, 0},
+	{0, 3, 4, 6, 0, 0, 0, 0},
+	{1, 3, 4, 6, 0, 0, 0, 0},
+	{0, 1, 3, 4, 6, 0, 0, 0},
+	{2, 3, 4, 6, 0, 0, 0, 0},
+	{0, 2, 3, 4, 6, 0, 0, 0},
+	{1, 2, 3, 4, 6, 0, 0, 0},
+	{0, 1, 2, 3, 4, 6, 0, 0},
+	{5, 6, 0, 0, 0, 0, 0, 0},
+	{0, 5, 6, 0, 0, 0, 0, 0},
+	{1, 5, 6, 0, 0, 0, 0, 0},
+	{0, 1, 5, 6, 0, 0, 0, 0},
+	{2, 5, 6, 0, 0, 0, 0, 0},
+	{0, 2, 5, 6, 0, 0, 0, 0},
+	{1, 2, 5, 6, 0, 0, 0, 0},
+	{0, 1, 2, 5, 6, 0, 0, 0},
+	{3, 5, 6, 0, 0, 0, 0, 0},
+	{0, 3, 5, 6, 0, 0, 0, 0},
+	{1, 3, 5, 6, 0, 0, 0, 0},
+	{0, 1, 3, 5, 6, 0, 0, 0},
+	{2, 3, 5, 6, 0, 0, 0, 0},
+	{0, 2, 3, 5, 6, 0, 0, 0},
+	{1, 2, 3, 5, 6, 0, 0, 0},
+	{0, 1, 2, 3, 5, 6, 0, 0},
+	{4, 5, 6, 0, 0, 0, 0, 0},
+	{0, 4, 5, 6, 0, 0, 0, 0},
+	{1, 4, 5, 6, 0, 0, 0, 0},
+	{0, 1, 4, 5, 6, 0, 0, 0},
+	{2, 4, 5, 6, 0, 0, 0, 0},
+	{0, 2, 4, 5, 6, 0, 0, 0},
+	{1, 2, 4, 5, 6, 0, 0, 0},
+	{0, 1, 2, 4, 5, 6, 0, 0},
+	{3, 4, 5, 6, 0, 0, 0, 0},
+	{0, 3, 4, 5, 6, 0, 0, 0},
+	{1, 3, 4, 5, 6, 0, 0, 0},
+	{0, 1, 3, 4, 5, 6, 0, 0},
+	{2, 3, 4, 5, 6, 0, 0, 0},
+	{0, 2, 3, 4, 5, 6, 0, 0},
+	{1, 2, 3, 4, 5, 6, 0, 0},
+	{0, 1, 2, 3, 4, 5, 6, 0},
+	{7, 0, 0, 0, 0, 0, 0, 0},
+	{0, 7, 0, 0, 0, 0, 0, 0},
+	{1, 7, 0, 0, 0, 0, 0, 0},
+	{0, 1, 7, 0, 0, 0, 0, 0},
+	{2, 7, 0, 0, 0, 0, 0, 0},
+	{0, 2, 7, 0, 0, 0, 0, 0},
+	{1, 2, 7, 0, 0, 0, 0, 0},
+	{0, 1, 2, 7, 0, 0, 0, 0},
+	{3, 7, 0, 0, 0, 0, 0, 0},
+	{0, 3, 7, 0, 0, 0, 0, 0},
+	{1, 3, 7, 0, 0, 0, 0, 0},
+	{0, 1, 3, 7, 0, 0, 0, 0},
+	{2, 3, 7, 0, 0, 0, 0, 0},
+	{0, 2, 3, 7, 0, 0, 0, 0},
+	{1, 2, 3, 7, 0, 0, 0, 0},
+	{0, 1, 2, 3, 7, 0, 0, 0},
+	{4, 7, 0, 0, 0, 0, 0, 0},
+	{0, 4, 7, 0, 0, 0, 0, 0},
+	{1, 4, 7, 0, 0, 0, 0, 0},
+	{0, 1, 4, 7, 0, 0, 0, 0},
+	{2, 4, 7, 0, 0, 0, 0, 0},
+	{0, 2, 4, 7, 0, 0, 0, 0},
+	{1, 2, 4, 7, 0, 0, 0, 0},
+	{0, 1, 2, 4, 7, 0, 0, 0},
+	{3, 4, 7, 0, 0, 0, 0, 0},
+	{0, 3, 4, 7, 0, 0, 0, 0},
+	{1, 3, 4, 7, 0, 0, 0, 0},
+	{0, 1, 3, 4, 7, 0, 0, 0},
+	{2, 3, 4, 7, 0, 0, 0, 0},
+	{0, 2, 3, 4, 7, 0, 0, 0},
+	{1, 2, 3, 4, 7, 0, 0, 0},
+	{0, 1, 2, 3, 4, 7, 0, 0},
+	{5, 7, 0, 0, 0, 0, 0, 0},
+	{0, 5, 7, 0, 0, 0, 0, 0},
+	{1, 5, 7, 0, 0, 0, 0, 0},
+	{0, 1, 5, 7, 0, 0, 0, 0},
+	{2, 5, 7, 0, 0, 0, 0, 0},
+	{0, 2, 5, 7, 0, 0, 0, 0},
+	{1, 2, 5, 7, 0, 0, 0, 0},
+	{0, 1, 2, 5, 7, 0, 0, 0},
+	{3, 5, 7, 0, 0, 0, 0, 0},
+	{0, 3, 5, 7, 0, 0, 0, 0},
+	{1, 3, 5, 7, 0, 0, 0, 0},
+	{0, 1, 3, 5, 7, 0, 0, 0},
+	{2, 3, 5, 7, 0, 0, 0, 0},
+	{0, 2, 3, 5, 7, 0, 0, 0},
+	{1, 2, 3, 5, 7, 0, 0, 0},
+	{0, 1, 2, 3, 5, 7, 0, 0},
+	{4, 5, 7, 0, 0, 0, 0, 0},
+	{0, 4, 5, 7, 0, 0, 0, 0},
+	{1, 4, 5, 7, 0, 0, 0, 0},
+	{0, 1, 4, 5, 7, 0, 0, 0},
+	{2, 4, 5, 7, 0, 0, 0, 0},
+	{0, 2, 4, 5, 7, 0, 0, 0},
+	{1, 2, 4, 5, 7, 0, 0, 0},
+	{0, 1, 2, 4, 5, 7, 0, 0},
+	{3, 4, 5, 7, 0, 0, 0, 0},
+	{0, 3, 4, 5, 7, 0, 0, 0},
+	{1, 3, 4, 5, 7, 0, 0, 0},
+	{0, 1, 3, 4, 5, 7, 0, 0},
+	{2, 3, 4, 5, 7, 0, 0, 0},
+	{0, 2, 3, 4, 5, 7, 0, 0},
+	{1, 2, 3, 4, 5, 7, 0, 0},
+	{0, 1, 2, 3, 4, 5, 7, 0},
+	{6, 7, 0, 0, 0, 0, 0, 0},
+	{0, 6, 7, 0, 0, 0, 0, 0},
+	{1, 6, 7, 0, 0, 0, 0, 0},
+	{0, 1, 6, 7, 0, 0, 0, 0},
+	{2, 6, 7, 0, 0, 0, 0, 0},
+	{0, 2, 6, 7, 0, 0, 0, 0},
+	{1, 2, 6, 7, 0, 0, 0, 0},
+	{0, 1, 2, 6, 7, 0, 0, 0},
+	{3, 6, 7, 0, 0, 0, 0, 0},
+	{0, 3, 6, 7, 0, 0, 0, 0},
+	{1, 3, 6, 7, 0, 0, 0, 0},
+	{0, 1, 3, 6, 7, 0, 0, 0},
+	{2, 3, 6, 7, 0, 0, 0, 0},
+	{0, 2, 3, 6, 7, 0, 0, 0},
+	{1, 2, 3, 6, 7, 0, 0, 0},
+	{0, 1, 2, 3, 6, 7, 0, 0},
+	{4, 6, 7, 0, 0, 0, 0, 0},
+	{0, 4, 6, 7, 0, 0, 0, 0},
+	{1, 4, 6, 7, 0, 0, 0, 0},
+	{0, 1, 4, 6, 7, 0, 0, 0},
+	{2, 4, 6, 7, 0, 0, 0, 0},
+	{0, 2, 4, 6, 7, 0, 0, 0},
+	{1, 2, 4, 6, 7, 0, 0, 0},
+	{0, 1, 2, 4, 6, 7, 0, 0},
+	{3, 4, 6, 7, 0, 0, 0, 0},
+	{0, 3, 4, 6, 7, 0, 0, 0},
+	{1, 3, 4, 6, 7, 0, 0, 0},
+	{0, 1, 3, 4, 6, 7, 0, 0},
+	{2, 3, 4, 6, 7, 0, 0, 0},
+	{0, 2, 3, 4, 6, 7, 0, 0},
+	{1, 2, 3, 4, 6, 7, 0, 0},
+	{0, 1, 2, 3, 4, 6, 7, 0},
+	{5, 6, 7, 0, 0, 0, 0, 0},
+	{0, 5, 6, 7, 0, 0, 0, 0},
+	{1, 5, 6, 7, 0, 0, 0, 0},
+	{0, 1, 5, 6, 7, 0, 0, 0},
+	{2, 5, 6, 7, 0, 0, 0, 0},
+	{0, 2, 5, 6, 7, 0, 0, 0},
+	{1, 2, 5, 6, 7, 0, 0, 0},
+	{0, 1, 2, 5, 6, 7, 0, 0},
+	{3, 5, 6, 7, 0, 0, 0, 0},
+	{0, 3, 5, 6, 7, 0, 0, 0},
+	{1, 3, 5, 6, 7, 0, 0, 0},
+	{0, 1, 3, 5, 6, 7, 0, 0},
+	{2, 3, 5, 6, 7, 0, 0, 0},
+	{0, 2, 3, 5, 6, 7, 0, 0},
+	{1, 2, 3, 5, 6, 7, 0, 0},
+	{0, 1, 2, 3, 5, 6, 7, 0},
+	{4, 5, 6, 7, 0, 0, 0, 0},
+	{0, 4, 5, 6, 7, 0, 0, 0},
+	{1, 4, 5, 6, 7, 0, 0, 0},
+	{0, 1, 4, 5, 6, 7, 0, 0},
+	{2, 4, 5, 6, 7, 0, 0, 0},
+	{0, 2, 4, 5, 6, 7, 0, 0},
+	{1, 2, 4, 5, 6, 7, 0, 0},
+	{0, 1, 2, 4, 5, 6, 7, 0},
+	{3, 4, 5, 6, 7, 0, 0, 0},
+	{0, 3, 4, 5, 6, 7, 0, 0},
+	{1, 3, 4, 5, 6, 7, 0, 0},
+	{0, 1, 3, 4, 5, 6, 7, 0},
+	{2, 3, 4, 5, 6, 7, 0, 0},
+	{0, 2, 3, 4, 5, 6, 7, 0},
+	{1, 2, 3, 4, 5, 6, 7, 0},
+	{0, 1, 2, 3, 4, 5, 6, 7},
+};
+
+static size_t
+bitset_extract_generic(const uint64_t *words,
+		       size_t i,
+		       size_t n,
+		       uint64_t w,
+		       uint32_t *out,
+		       size_t max)
+{
+	size_t k = 0;
+
+	for (;;)
+	{
+		uint32_t base = (uint32_t)(i * BITSET_WORD_BITS);
+		while (w)
+		{
+			if (k == max)
+				return k;
+			out[k++] = base + (uint32_t)__builtin_ctzll(w);
+			w &= w - 1;
+		}
+		if (++i == n)
+			return k;
+		w = words[i];
+	}
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+/*
+ * Dense words are decoded a byte at a time: the lookup table gives the bit
+ * positions of the byte, which are widened, offset and stored as 8 lanes in
+ * one go, and the output pointer advances by the popcount of the byte.
+ * Sparse words, and the end of the output buffer, use the ctz loop.
+ */
+NOSHIRO_TARGET("avx2,popcnt")
+static size_t
+bitset_extract_avx2(const uint64_t *words,
+		    size_t i,
+		    size_t n,
+		    uint64_t w,
+		    uint32_t *out,
+		    size_t max)
+{
+	size_t k = 0;
+
+	for (;;)
+	{
+		uint32_t base = (uint32_t)(i * BITSET_WORD_BITS);
+		if (w != 0 && k + BITSET_WORD_BITS + 8 <= max &&
+		    __builtin_popcountll(w) >= 8)
+		{
+			for (int b = 0; b < 8; b++, w >>= 8)
+			{
+				uint8_t byte = (uint8_t)w;
+				__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+				    (const __m128i *)(const void *)bitset_decode_lut[byte]));
+				idx = _mm256_add_epi32(
+				    idx, _mm256_set1_epi32((int)(base + 8 * b)));
+				_mm256_storeu_si256((__m256i *)(void *)(out + k), idx);
+				k += (size_t)__builtin_popcount(byte);
+			}
+		}
+		else
+		{
+			while (w)
+			{
+				if (k == max)
+					return k;
+				out[k++] = base + (uint32_t)__builtin_ctzll(w);
+				w &= w - 1;
+			}
+		}
+		if (++i == n)
+			return k;
+		w = words[i];
+	}
+}
+
+#endif /* NOSHIRO_X86_DISPATCH */
@@ -25,6 +25,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 enum
 {
@@ -33,20 +34,85 @@ enum
 	BITSET_STATE_ANY   ///< Some bits are LW_TRUE
 };
 
+/* Bit i lives in data[i / 64] at bit position i % 64. Bits of the last
+ * word past length are always zero. */
 typedef struct {
 	size_t length;
 	size_t capacity;
-	char data[];
+	uint64_t data[];
 } bitset_t;
 
+#define BITSET_WORD_BITS   64
+#define BITSET_WORDS(bits) (((bits) + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS)
+
 bitset_t *bitset_new(size_t size);
 void bitset_free(bitset_t *bs);
 void bitset_set(bitset_t *bs, size_t index);
 void bitset_clear(bitset_t *bs, size_t index);
-bool bitset_test(bitset_t *bs, size_t index);
+bool bitset_test(const bitset_t *bs, size_t index);
 void bitset_flip(bitset_t *bs, size_t index);
-int bitset_state(bitset_t *bs);
-size_t bitset_count(bitset_t *bs);
-size_t bitset_size(bitset_t *bs);
+int bitset_state(const bitset_t *bs);
+bool bitset_any(const bitset_t *bs);
+bool bitset_all(const bitset_t *bs);
+bool bitset_none(const bitset_t *bs);
+size_t bitset_count(const bitset_t *bs);
+size_t bitset_size(const bitset_t *bs);
+
+/*
+ * Change the length to \a size bits, reallocating with geometric growth
+ * when it exceeds the capacity. New bits are LW_FALSE. Returns the bitset
+ * to use from now on, or NULL (leaving \a bs untouched) when out of memory.
+ */
+bitset_t *bitset_resize(bitset_t *bs, size_t size);
+
+/*
+ * Range operations over the half-open interval [begin, end), clamped to
+ * the length. Whole words in the middle are handled with memset/popcount.
+ */
+void bitset_set_range(bitset_t *bs, size_t begin, size_t end);
+void bitset_clear_range(bitset_t *bs, size_t begin, size_t end);
+size_t bitset_count_range(const bitset_t *bs, size_t begin, size_t end);
+bool bitset_any_range(const bitset_t *bs, size_t begin, size_t end);
+
+/*
+ * Bulk set algebra over whole words, vectorized at runtime when the CPU
+ * allows. Bitsets of different lengths are aligned at bit 0 and the
+ * missing bits of the shorter one read as LW_FALSE.
+ */
+
+/* In place: dst = dst op src; dst keeps its length */
+void bitset_and(bitset_t *dst, const bitset_t *src);
+void bitset_or(bitset_t *dst, const bitset_t *src);
+void bitset_xor(bitset_t *dst, const bitset_t *src);
+void bitset_andnot(bitset_t *dst, const bitset_t *src);
+
+/* Out of place: a new bitset as long as the longer operand */
+bitset_t *bitset_and_new(const bitset_t *a, const bitset_t *b);
+bitset_t *bitset_or_new(const bitset_t *a, const bitset_t *b);
+bitset_t *bitset_xor_new(const bitset_t *a, const bitset_t *b);
+bitset_t *bitset_andnot_new(const bitset_t *a, const bitset_t *b);
+
+/* Fused: number of bits in a op b, without materializing it */
+size_t bitset_and_count(const bitset_t *a, const bitset_t *b);
+size_t bitset_or_count(const bitset_t *a, const bitset_t *b);
+size_t bitset_xor_count(const bitset_t *a, const bitset_t *b);
+size_t bitset_andnot_count(const bitset_t *a, const bitset_t *b);
+bool bitset_intersects(const bitset_t *a, const bitset_t *b);
+
+/*
+ * Iteration. The searches skip whole zero words, so walking the set bits
+ * costs time proportional to their number plus length / 64.
+ */
+#define BITSET_NPOS ((size_t)-1)
+
+size_t bitset_next_set(const bitset_t *bs, size_t from);
+size_t bitset_next_clear(const bitset_t *bs, size_t from);
+size_t bitset_prev_set(const bitset_t *bs, size_t from);
+size_t bitset_extract_set(const bitset_t *bs, size_t from, uint32_t *out, size_t max);
+
+/* Loop over the indices of the LW_TRUE bits in ascending order */
+#define BITSET_FOREACH(bs, i) \
+	for (size_t i = bitset_next_set((bs), 0); i != BITSET_NPOS; \
+	     i = bitset_next_set((bs), i + 1))
 
 #endif /* __NOSHIRO_BITSET_H__ */
\ No newline at end of file
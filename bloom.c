@@ -0,0 +1,423 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "bloom.h"
+#include "bitset.h"
+#include "hash.h"
+#include "trace.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOOM_MAGIC         "NSHBLOOM"
+#define BLOOM_VERSION       2 /* 2: keys hashed with hash64() */
+#define BLOOM_HEADER_SIZE   40
+#define BLOOM_BLOCK_WORDS   8 /* 512 bits, one cache line */
+#define BLOOM_BLOCK_BITS    (BLOOM_BLOCK_WORDS * BITSET_WORD_BITS)
+#define BLOOM_MAX_HASHES    16
+#define BLOOM_PREFETCH_DIST 8
+#define BLOOM_LN2           0.69314718055994530942
+
+enum
+{
+	BLOOM_BLOCKED = 1
+};
+
+struct bloom_s {
+	bitset_t *bits;   /* storage; words points into its data */
+	uint64_t *words;  /* first filter word, cache-line aligned when blocked */
+	uint64_t nbits;   /* number of filter bits */
+	uint64_t nblocks; /* blocked: number of 512-bit blocks */
+	uint64_t count;   /* keys added */
+	uint32_t k;       /* probes per key */
+	uint32_t flags;
+};
+
+/* ---------------------------- hashing ---------------------------- */
+
+/* Map a 64-bit value onto [0, n) without a division */
+static inline uint64_t
+bloom_reduce(uint64_t x, uint64_t n)
+{
+	uint64_t lo, hi;
+
+	hash_mul128(x, n, &lo, &hi);
+	return hi;
+}
+
+/*
+ * Kirsch-Mitzenmacher double hashing: probe i is h1 + i * h2. h2 is forced
+ * odd so the probes of a key never collapse onto one bit.
+ */
+#define BLOOM_H1(hash) (hash)
+#define BLOOM_H2(hash) (((hash) >> 32 | (hash) << 32) | 1)
+
+/* Within a block: the top 9 bits of a 32-bit double hash pick the bit */
+#define BLOOM_BLOCK_SEED(hash) ((hash) * 0x9e3779b97f4a7c15ULL)
+#define BLOOM_BLOCK_BIT(seed, i) \
+	((uint32_t)((uint32_t)(seed) + (uint32_t)(i) * ((uint32_t)((seed) >> 32) | 1)) >> 23)
+
+static inline uint64_t *
+bloom_block(const bloom_t *bf, uint64_t hash)
+{
+	return bf->words + bloom_reduce(hash, bf->nblocks) * BLOOM_BLOCK_WORDS;
+}
+
+/* ---------------------------- lifecycle ---------------------------- */
+
+static void
+bloom_size(size_t expected, double fpp, uint64_t *nbits, uint32_t *k)
+{
+	if (expected == 0)
+		expected = 1;
+	if (!(fpp > 0.0 && fpp < 1.0))
+		fpp = 0.01;
+
+	/* m = -n ln p / (ln 2)^2, k = m / n ln 2 */
+	double bits_per_key = -log(fpp) / (BLOOM_LN2 * BLOOM_LN2);
+	double m = ceil(bits_per_key * (double)expected);
+	uint32_t hashes = (uint32_t)(bits_per_key * BLOOM_LN2 + 0.5);
+
+	*nbits = m < BITSET_WORD_BITS ? BITSET_WORD_BITS : (uint64_t)m;
+	*k = hashes < 1 ? 1 : hashes > BLOOM_MAX_HASHES ? BLOOM_MAX_HASHES : hashes;
+}
+
+static bloom_t *
+bloom_alloc(uint64_t nbits, uint32_t k, uint32_t flags)
+{
+	bloom_t *bf = (bloom_t *)calloc(1, sizeof(bloom_t));
+	if (bf == NULL)
+		return NULL;
+
+	bf->k = k;
+	bf->flags = flags;
+	if (flags & BLOOM_BLOCKED)
+	{
+		bf->nblocks = (nbits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+		bf->nbits = bf->nblocks * BLOOM_BLOCK_BITS;
+		/* Slack to move the first block onto a cache line boundary */
+		bf->bits = bitset_new(bf->nbits + BLOOM_BLOCK_BITS - BITSET_WORD_BITS);
+		if (bf->bits == NULL)
+			goto fail;
+		uintptr_t p = (uintptr_t)bf->bits->data;
+		bf->words = bf->bits->data + ((64 - p % 64) % 64) / sizeof(uint64_t);
+	}
+	else
+	{
+		bf->nbits = BITSET_WORDS(nbits) * BITSET_WORD_BITS;
+		bf->bits = bitset_new(bf->nbits);
+		if (bf->bits == NULL)
+			goto fail;
+		bf->words = bf->bits->data;
+	}
+	return bf;
+
+fail:
+	free(bf);
+	return NULL;
+}
+
+bloom_t *
+bloom_new(size_t expected, double fpp)
+{
+	uint64_t nbits;
+	uint32_t k;
+	bloom_size(expected, fpp, &nbits, &k);
+	return bloom_alloc(nbits, k, 0);
+}
+
+bloom_t *
+bloom_new_blocked(size_t expected, double fpp)
+{
+	uint64_t nbits;
+	uint32_t k;
+	bloom_size(expected, fpp, &nbits, &k);
+	return bloom_alloc(nbits, k, BLOOM_BLOCKED);
+}
+
+void
+bloom_free(bloom_t *bf)
+{
+	if (bf == NULL)
+		return;
+	bitset_free(bf->bits);
+	free(bf);
+}
+
+void
+bloom_clear(bloom_t *bf)
+{
+	memset(bf->words, 0, bf->nbits / 8);
+	bf->count = 0;
+}
+
+/* ---------------------------- add / query ---------------------------- */
+
+void
+bloom_add_hash(bloom_t *bf, uint64_t hash)
+{
+	bf->count++;
+	if (bf->flags & BLOOM_BLOCKED)
+	{
+		uint64_t *block = bloom_block(bf, hash);
+		uint64_t seed = BLOOM_BLOCK_SEED(hash);
+		for (uint32_t i = 0; i < bf->k; i++)
+		{
+			uint32_t bit = BLOOM_BLOCK_BIT(seed, i);
+			block[bit / BITSET_WORD_BITS] |= (uint64_t)1 << (bit % BITSET_WORD_BITS);
+		}
+		return;
+	}
+
+	uint64_t h1 = BLOOM_H1(hash), h2 = BLOOM_H2(hash);
+	for (uint32_t i = 0; i < bf->k; i++)
+	{
+		uint64_t bit = bloom_reduce(h1 + i * h2, bf->nbits);
+		bf->words[bit / BITSET_WORD_BITS] |= (uint64_t)1 << (bit % BITSET_WORD_BITS);
+	}
+}
+
+bool
+bloom_contains_hash(const bloom_t *bf, uint64_t hash)
+{
+	if (bf->flags & BLOOM_BLOCKED)
+	{
+		const uint64_t *block = bloom_block(bf, hash);
+		uint64_t seed = BLOOM_BLOCK_SEED(hash);
+		for (uint32_t i = 0; i < bf->k; i++)
+		{
+			uint32_t bit = BLOOM_BLOCK_BIT(seed, i);
+			if (!(block[bit / BITSET_WORD_BITS] >> (bit % BITSET_WORD_BITS) & 1))
+				return false;
+		}
+		return true;
+	}
+
+	uint64_t h1 = BLOOM_H1(hash), h2 = BLOOM_H2(hash);
+	for (uint32_t i = 0; i < bf->k; i++)
+	{
+		uint64_t bit = bloom_reduce(h1 + i * h2, bf->nbits);
+		if (!(bf->words[bit / BITSET_WORD_BITS] >> (bit % BITSET_WORD_BITS) & 1))
+			return false;
+	}
+	return true;
+}
+
+void
+bloom_add(bloom_t *bf, const void *key, size_t len)
+{
+	bloom_add_hash(bf, hash64(key, len, 0));
+}
+
+bool
+bloom_contains(const bloom_t *bf, const void *key, size_t len)
+{
+	return bloom_contains_hash(bf, hash64(key, len, 0));
+}
+
+/* Touch the cache lines a later key will probe */
+static inline void
+bloom_prefetch(const bloom_t *bf, uint64_t hash, int rw)
+{
+	if (bf->flags & BLOOM_BLOCKED)
+	{
+		if (rw)
+			__builtin_prefetch(bloom_block(bf, hash), 1);
+		else
+			__builtin_prefetch(bloom_block(bf, hash), 0);
+		return;
+	}
+
+	uint64_t h1 = BLOOM_H1(hash), h2 = BLOOM_H2(hash);
+	for (uint32_t i = 0; i < bf->k; i++)
+	{
+		const uint64_t *p = bf->words + bloom_reduce(h1 + i * h2, bf->nbits) / BITSET_WORD_BITS;
+		if (rw)
+			__builtin_prefetch(p, 1);
+		else
+			__builtin_prefetch(p, 0);
+	}
+}
+
+void
+bloom_add_hashes(bloom_t *bf, const uint64_t *hashes, size_t n)
+{
+	TRACE_BEGIN_N(span, "bloom_add_hashes", n);
+	for (size_t i = 0; i < n && i < BLOOM_PREFETCH_DIST; i++)
+		bloom_prefetch(bf, hashes[i], 1);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (i + BLOOM_PREFETCH_DIST < n)
+			bloom_prefetch(bf, hashes[i + BLOOM_PREFETCH_DIST], 1);
+		bloom_add_hash(bf, hashes[i]);
+	}
+	TRACE_END(span);
+}
+
+size_t
+bloom_contains_hashes(const bloom_t *bf, const uint64_t *hashes, size_t n, bool *out)
+{
+	size_t hits = 0;
+	TRACE_BEGIN_N(span, "bloom_contains_hashes", n);
+
+	for (size_t i = 0; i < n && i < BLOOM_PREFETCH_DIST; i++)
+		bloom_prefetch(bf, hashes[i], 0);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (i + BLOOM_PREFETCH_DIST < n)
+			bloom_prefetch(bf, hashes[i + BLOOM_PREFETCH_DIST], 0);
+		bool found = bloom_contains_hash(bf, hashes[i]);
+		if (out)
+			out[i] = found;
+		hits += found;
+	}
+	TRACE_END(span);
+	return hits;
+}
+
+int
+bloom_merge(bloom_t *dst, const bloom_t *src)
+{
+	if (dst->nbits != src->nbits || dst->k != src->k || dst->flags != src->flags)
+		return -1;
+
+	size_t n = dst->nbits / BITSET_WORD_BITS;
+	for (size_t i = 0; i < n; i++)
+		dst->words[i] |= src->words[i];
+	dst->count += src->count;
+	return 0;
+}
+
+uint64_t
+bloom_bit_count(const bloom_t *bf)
+{
+	return bf->nbits;
+}
+
+uint32_t
+bloom_hash_count(const bloom_t *bf)
+{
+	return bf->k;
+}
+
+bool
+bloom_is_blocked(const bloom_t *bf)
+{
+	return (bf->flags & BLOOM_BLOCKED) != 0;
+}
+
+uint64_t
+bloom_insert_count(const bloom_t *bf)
+{
+	return bf->count;
+}
+
+/* ---------------------------- serialization ---------------------------- */
+
+static void
+bloom_put32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static void
+bloom_put64(uint8_t *p, uint64_t v)
+{
+	bloom_put32(p, (uint32_t)v);
+	bloom_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t
+bloom_get32(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t
+bloom_get64(const uint8_t *p)
+{
+	return bloom_get32(p) | (uint64_t)bloom_get32(p + 4) << 32;
+}
+
+size_t
+bloom_serialized_size(const bloom_t *bf)
+{
+	return BLOOM_HEADER_SIZE + bf->nbits / 8;
+}
+
+/*
+ * Layout:
+ *   header  magic[8], u32 version, u32 flags, u32 k, u32 reserved,
+ *           u64 bit count, u64 insert count
+ *   words   u64 filter words
+ */
+size_t
+bloom_serialize(const bloom_t *bf, void *buf)
+{
+	uint8_t *out = (uint8_t *)buf;
+	size_t n = bf->nbits / BITSET_WORD_BITS;
+
+	memcpy(out, BLOOM_MAGIC, 8);
+	bloom_put32(out + 8, BLOOM_VERSION);
+	bloom_put32(out + 12, bf->flags);
+	bloom_put32(out + 16, bf->k);
+	bloom_put32(out + 20, 0);
+	bloom_put64(out + 24, bf->nbits);
+	bloom_put64(out + 32, bf->count);
+
+	out += BLOOM_HEADER_SIZE;
+	for (size_t i = 0; i < n; i++)
+		bloom_put64(out + i * 8, bf->words[i]);
+	return BLOOM_HEADER_SIZE + n * 8;
+}
+
+bloom_t *
+bloom_deserialize(const void *buf, size_t len)
+{
+	const uint8_t *in = (const uint8_t *)buf;
+	if (len < BLOOM_HEADER_SIZE || memcmp(in, BLOOM_MAGIC, 8) != 0 ||
+	    bloom_get32(in + 8) != BLOOM_VERSION)
+		return NULL;
+
+	uint32_t flags = bloom_get32(in + 12);
+	uint32_t k = bloom_get32(in + 16);
+	uint64_t nbits = bloom_get64(in + 24);
+	uint64_t block = flags & BLOOM_BLOCKED ? BLOOM_BLOCK_BITS : BITSET_WORD_BITS;
+
+	if ((flags & ~(uint32_t)BLOOM_BLOCKED) || k < 1 || k > BLOOM_MAX_HASHES ||
+	    nbits == 0 || nbits % block != 0 ||
+	    (len - BLOOM_HEADER_SIZE) / 8 < nbits / BITSET_WORD_BITS)
+		return NULL;
+
+	bloom_t *bf = bloom_alloc(nbits, k, flags);
+	if (bf == NULL)
+		return NULL;
+	bf->count = bloom_get64(in + 32);
+
+	in += BLOOM_HEADER_SIZE;
+	for (size_t i = 0; i < nbits / BITSET_WORD_BITS; i++)
+		bf->words[i] = bloom_get64(in + i * 8);
+	return bf;
+}
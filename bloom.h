@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_BLOOM_H__
+#define __NOSHIRO_BLOOM_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Bloom filter: a set membership test with no false negatives and a tunable
+ * false positive rate, stored in a bitset_t.
+ *
+ * The k probe positions of a key are derived from a single 64-bit hash by
+ * double hashing, so callers that already hash their keys can use the
+ * *_hash entry points directly. The blocked variant confines all probes of
+ * a key to one 64-byte cache line: a lookup costs a single cache miss, for
+ * a slightly higher false positive rate at the same size.
+ */
+typedef struct bloom_s bloom_t;
+
+/**
+ * @param expected number of keys the filter is sized for
+ * @param fpp      target false positive probability, in (0, 1)
+ * @return a new empty filter, or NULL on failure
+ */
+bloom_t *bloom_new(size_t expected, double fpp);
+bloom_t *bloom_new_blocked(size_t expected, double fpp);
+void bloom_free(bloom_t *bf);
+void bloom_clear(bloom_t *bf);
+
+void bloom_add(bloom_t *bf, const void *key, size_t len);
+bool bloom_contains(const bloom_t *bf, const void *key, size_t len);
+
+/*
+ * Same, for keys already reduced to a well mixed 64-bit hash. bloom_add()
+ * and bloom_contains() use hash64(key, len, 0), so both can be mixed.
+ */
+void bloom_add_hash(bloom_t *bf, uint64_t hash);
+bool bloom_contains_hash(const bloom_t *bf, uint64_t hash);
+
+/**
+ * Batch versions of the above. The memory of upcoming keys is prefetched
+ * while the current one is probed, so the cache misses of a batch overlap.
+ *
+ * @param out if not NULL, receives one result per hash
+ * @return    the number of hashes that may be present
+ */
+void bloom_add_hashes(bloom_t *bf, const uint64_t *hashes, size_t n);
+size_t bloom_contains_hashes(const bloom_t *bf, const uint64_t *hashes, size_t n, bool *out);
+
+/**
+ * Add every key of @p src to @p dst. Both must have been created with the
+ * same parameters (or deserialized from such filters).
+ *
+ * @return 0 on success, -1 if the filters have different shapes
+ */
+int bloom_merge(bloom_t *dst, const bloom_t *src);
+
+uint64_t bloom_bit_count(const bloom_t *bf);
+uint32_t bloom_hash_count(const bloom_t *bf);
+bool bloom_is_blocked(const bloom_t *bf);
+
+/* Number of add calls since creation or the last clear */
+uint64_t bloom_insert_count(const bloom_t *bf);
+
+/*
+ * Serialization to a little-endian buffer, e.g. stored next to the index
+ * the filter guards.
+ */
+size_t bloom_serialized_size(const bloom_t *bf);
+
+/**
+ * @param buf buffer of at least bloom_serialized_size() bytes
+ * @return    the number of bytes written
+ */
+size_t bloom_serialize(const bloom_t *bf, void *buf);
+bloom_t *bloom_deserialize(const void *buf, size_t len);
+
+#endif /* __NOSHIRO_BLOOM_H__ */
@@ -0,0 +1,160 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "cbitset.h"
+#include <stdlib.h>
+
+#define cbitset_word(index) ((index) / BITSET_WORD_BITS)
+#define cbitset_mask(index) ((uint64_t)1 << ((index) % BITSET_WORD_BITS))
+
+cbitset_t *
+cbitset_new(size_t size)
+{
+	size_t words = BITSET_WORDS(size) ? BITSET_WORDS(size) : 1;
+	cbitset_t *bs = (cbitset_t *)malloc(sizeof(cbitset_t) +
+					    words * sizeof(_Atomic uint64_t));
+	if (bs == NULL)
+		return NULL;
+
+	bs->length = size;
+	for (size_t i = 0; i < words; i++)
+		atomic_init(&bs->data[i], 0);
+	return bs;
+}
+
+void
+cbitset_free(cbitset_t *bs)
+{
+	free(bs);
+}
+
+bool
+cbitset_test_and_set(cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return false;
+
+	_Atomic uint64_t *w = &bs->data[cbitset_word(index)];
+	uint64_t m = cbitset_mask(index);
+
+	if (atomic_load_explicit(w, memory_order_relaxed) & m)
+	{
+		/* Pair with the releasing fetch_or of the thread that won */
+		atomic_thread_fence(memory_order_acquire);
+		return true;
+	}
+	return (atomic_fetch_or_explicit(w, m, memory_order_acq_rel) & m) != 0;
+}
+
+bool
+cbitset_test_and_clear(cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return false;
+
+	_Atomic uint64_t *w = &bs->data[cbitset_word(index)];
+	uint64_t m = cbitset_mask(index);
+
+	if (!(atomic_load_explicit(w, memory_order_relaxed) & m))
+	{
+		atomic_thread_fence(memory_order_acquire);
+		return false;
+	}
+	return (atomic_fetch_and_explicit(w, ~m, memory_order_acq_rel) & m) != 0;
+}
+
+void
+cbitset_set(cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return;
+
+	atomic_fetch_or_explicit(&bs->data[cbitset_word(index)],
+				 cbitset_mask(index),
+				 memory_order_release);
+}
+
+void
+cbitset_clear(cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return;
+
+	atomic_fetch_and_explicit(&bs->data[cbitset_word(index)],
+				  ~cbitset_mask(index),
+				  memory_order_release);
+}
+
+bool
+cbitset_test(const cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return false;
+
+	_Atomic uint64_t *w = (_Atomic uint64_t *)&bs->data[cbitset_word(index)];
+	return (atomic_load_explicit(w, memory_order_acquire) & cbitset_mask(index)) != 0;
+}
+
+bool
+cbitset_test_relaxed(const cbitset_t *bs, size_t index)
+{
+	if (index >= bs->length)
+		return false;
+
+	_Atomic uint64_t *w = (_Atomic uint64_t *)&bs->data[cbitset_word(index)];
+	return (atomic_load_explicit(w, memory_order_relaxed) & cbitset_mask(index)) != 0;
+}
+
+size_t
+cbitset_count(const cbitset_t *bs)
+{
+	size_t words = BITSET_WORDS(bs->length);
+	size_t count = 0;
+
+	/* Bits past length are always zero, so whole words can be counted */
+	for (size_t i = 0; i < words; i++)
+		count += (size_t)__builtin_popcountll(
+		    atomic_load_explicit(&bs->data[i], memory_order_relaxed));
+	return count;
+}
+
+void
+cbitset_reset(cbitset_t *bs)
+{
+	size_t words = BITSET_WORDS(bs->length);
+	for (size_t i = 0; i < words; i++)
+		atomic_store_explicit(&bs->data[i], 0, memory_order_relaxed);
+}
+
+bitset_t *
+cbitset_to_bitset(const cbitset_t *bs)
+{
+	bitset_t *out = bitset_new(bs->length);
+	if (out == NULL)
+		return NULL;
+
+	size_t words = BITSET_WORDS(bs->length);
+	for (size_t i = 0; i < words; i++)
+		out->data[i] = atomic_load_explicit(
+		    (_Atomic uint64_t *)&bs->data[i], memory_order_acquire);
+	return out;
+}
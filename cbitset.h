@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_CBITSET_H__
+#define __NOSHIRO_CBITSET_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+/*
+ * Concurrent bitset.
+ *
+ * Same layout as bitset_t, but every word is an atomic, so threads can
+ * mark and test bits of a shared set without a lock. Modifying calls are
+ * single fetch_or / fetch_and operations on the word holding the bit and
+ * never lose updates made by other threads to neighbouring bits.
+ */
+typedef struct {
+	size_t length;
+	_Atomic uint64_t data[];
+} cbitset_t;
+
+cbitset_t *cbitset_new(size_t size);
+void cbitset_free(cbitset_t *bs);
+
+/**
+ * Atomically set the \a index bit.
+ *
+ * The word is read first and the read-modify-write is skipped when the bit
+ * is already set, so repeated visits of a node do not bounce the cache
+ * line between cores.
+ *
+ * @return the previous value of the bit; exactly one of several racing
+ *         callers sees false
+ */
+bool cbitset_test_and_set(cbitset_t *bs, size_t index);
+
+/**
+ * Atomically clear the \a index bit.
+ *
+ * @return the previous value of the bit
+ */
+bool cbitset_test_and_clear(cbitset_t *bs, size_t index);
+
+void cbitset_set(cbitset_t *bs, size_t index);
+void cbitset_clear(cbitset_t *bs, size_t index);
+
+/**
+ * Read a bit with acquire ordering: data published before the bit was set
+ * by another thread is visible after seeing it set.
+ */
+bool cbitset_test(const cbitset_t *bs, size_t index);
+
+/**
+ * Read a bit without ordering, for hot paths that only need the flag.
+ */
+bool cbitset_test_relaxed(const cbitset_t *bs, size_t index);
+
+/**
+ * Number of set bits. Concurrent updates may or may not be counted.
+ */
+size_t cbitset_count(const cbitset_t *bs);
+
+/**
+ * Clear every bit. Not safe against concurrent modification.
+ */
+void cbitset_reset(cbitset_t *bs);
+
+/**
+ * Copy the current bits into a new plain bitset, e.g. once a parallel
+ * phase is over.
+ */
+bitset_t *cbitset_to_bitset(const cbitset_t *bs);
+
+#endif /* __NOSHIRO_CBITSET_H__ */
@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_CPU_H__
+#define __NOSHIRO_CPU_H__
+
+/*
+ * Internal helpers for runtime CPU dispatch.
+ *
+ * SIMD kernels are compiled with NOSHIRO_TARGET() so the library itself
+ * needs no special compiler flags, and are only called after cpu_supports()
+ * confirmed the instruction set at runtime. Other compilers and
+ * architectures fall back to the portable code paths.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define NOSHIRO_X86_DISPATCH 1
+#define NOSHIRO_TARGET(isa)  __attribute__((target(isa)))
+#define cpu_supports(isa)    __builtin_cpu_supports(isa)
+#else
+#define NOSHIRO_TARGET(isa)
+#define cpu_supports(isa) 0
+#endif
+
+#endif /* __NOSHIRO_CPU_H__ */
@@ -18,4 +18,313 @@
  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
- */
\ No newline at end of file
+ */
+
+#include "hash.h"
+#include "stats.h"
+
+#include <string.h>
+
+static const uint64_t hash_secret[4] = {
+    0x2d358dccaa6c78a5ULL,
+    0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL,
+    0x4d5a2da51de1aa47ULL,
+};
+
+#define HASH_S0 hash_secret[0]
+#define HASH_S1 hash_secret[1]
+#define HASH_S2 hash_secret[2]
+#define HASH_S3 hash_secret[3]
+
+/* Full 64x64 -> 128 bit product: low half in *a, high half in *b */
+static inline void
+hash_mum(uint64_t *a, uint64_t *b)
+{
+	hash_mul128(*a, *b, a, b);
+}
+
+static inline uint64_t
+hash_mix(uint64_t a, uint64_t b)
+{
+	hash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t
+hash_read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint64_t
+hash_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t
+hash_premix(uint64_t seed)
+{
+	return seed ^ hash_mix(seed ^ HASH_S0, HASH_S1);
+}
+
+/*
+ * Inputs of up to 16 bytes are read as two possibly overlapping words
+ * without a loop: 4..16 bytes as four 32-bit reads, 1..3 bytes as the
+ * first, middle and last byte.
+ */
+static inline void
+hash_read_short(const uint8_t *p, size_t len, uint64_t *a, uint64_t *b)
+{
+	if (len >= 4)
+	{
+		size_t mid = (len >> 3) << 2;
+
+		*a = hash_read32(p) << 32 | hash_read32(p + mid);
+		*b = hash_read32(p + len - 4) << 32 | hash_read32(p + len - 4 - mid);
+	}
+	else if (len > 0)
+	{
+		*a = (uint64_t)p[0] << 16 | (uint64_t)p[len >> 1] << 8 | p[len - 1];
+		*b = 0;
+	}
+	else
+		*a = *b = 0;
+}
+
+/* 48-byte blocks feed three independent multiply chains */
+static inline void
+hash_blocks(uint64_t lane[3], const uint8_t *p, size_t nblocks)
+{
+	uint64_t l0 = lane[0], l1 = lane[1], l2 = lane[2];
+
+	for (; nblocks; nblocks--, p += 48)
+	{
+		l0 = hash_mix(hash_read64(p) ^ HASH_S1, hash_read64(p + 8) ^ l0);
+		l1 = hash_mix(hash_read64(p + 16) ^ HASH_S2, hash_read64(p + 24) ^ l1);
+		l2 = hash_mix(hash_read64(p + 32) ^ HASH_S3, hash_read64(p + 40) ^ l2);
+	}
+	lane[0] = l0;
+	lane[1] = l1;
+	lane[2] = l2;
+}
+
+/*
+ * The lanes fold into the chaining value of the 64-bit hash and, for the
+ * 128-bit hash, an independent second one. Without blocks all lanes hold
+ * the seed and lo is the seed itself.
+ */
+static inline uint64_t
+hash_fold_lo(const uint64_t lane[3])
+{
+	return lane[0] ^ lane[1] ^ lane[2];
+}
+
+static inline uint64_t
+hash_fold_hi(const uint64_t lane[3])
+{
+	return hash_mix(lane[1] ^ HASH_S2, lane[2] ^ HASH_S3) ^ lane[0];
+}
+
+static inline hash128_t
+hash_finish(uint64_t a, uint64_t b, uint64_t len, uint64_t lo, uint64_t hi,
+	    int wide)
+{
+	hash128_t r = {0, 0};
+	uint64_t a1 = a ^ HASH_S1, b1 = b ^ lo;
+
+	hash_mum(&a1, &b1);
+	r.lo = hash_mix(a1 ^ HASH_S0 ^ len, b1 ^ HASH_S1);
+	if (wide)
+	{
+		uint64_t a2 = a ^ HASH_S2, b2 = b ^ hi;
+
+		hash_mum(&a2, &b2);
+		r.hi = hash_mix(a2 ^ HASH_S3 ^ len, b2 ^ HASH_S0);
+	}
+	return r;
+}
+
+/*
+ * Inputs longer than 16 bytes end with the i < 48 bytes at p left over
+ * by the blocks, hashed 16 at a time, and the last 16 bytes of the whole
+ * input, which may reach back before p.
+ */
+static inline hash128_t
+hash_tail(const uint8_t *p, size_t i, uint64_t len, uint64_t lo, uint64_t hi,
+	  int wide)
+{
+	while (i > 16)
+	{
+		uint64_t x = hash_read64(p), y = hash_read64(p + 8);
+
+		lo = hash_mix(x ^ HASH_S1, y ^ lo);
+		if (wide)
+			hi = hash_mix(x ^ HASH_S2, y ^ hi);
+		p += 16;
+		i -= 16;
+	}
+	return hash_finish(hash_read64(p + i - 16), hash_read64(p + i - 8), len, lo,
+			   hi, wide);
+}
+
+static inline hash128_t
+hash_oneshot(const void *data, size_t len, uint64_t seed, int wide)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint64_t lane[3];
+
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_HASHES);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, len);
+
+	seed = hash_premix(seed);
+	lane[0] = lane[1] = lane[2] = seed;
+
+	if (len <= 16)
+	{
+		uint64_t a, b;
+
+		hash_read_short(p, len, &a, &b);
+		return hash_finish(a, b, len, seed, wide ? hash_fold_hi(lane) : 0,
+				   wide);
+	}
+
+	size_t nblocks = len / 48;
+	hash_blocks(lane, p, nblocks);
+	return hash_tail(p + nblocks * 48, len % 48, len, hash_fold_lo(lane),
+			 wide ? hash_fold_hi(lane) : 0, wide);
+}
+
+uint64_t
+hash64(const void *data, size_t len, uint64_t seed)
+{
+	return hash_oneshot(data, len, seed, 0).lo;
+}
+
+hash128_t
+hash128(const void *data, size_t len, uint64_t seed)
+{
+	return hash_oneshot(data, len, seed, 1);
+}
+
+uint64_t
+hash_u32(uint32_t key, uint64_t seed)
+{
+	uint64_t k = (uint64_t)key << 32 | key;
+
+	return hash_finish(k, k, 4, hash_premix(seed), 0, 0).lo;
+}
+
+uint64_t
+hash_u64(uint64_t key, uint64_t seed)
+{
+	return hash_finish(key << 32 | key >> 32, key, 8, hash_premix(seed), 0, 0).lo;
+}
+
+/* ---------------------------- streaming ---------------------------- */
+
+void
+hash_init(hash_state_t *st, uint64_t seed)
+{
+	st->seed = hash_premix(seed);
+	st->lane[0] = st->lane[1] = st->lane[2] = st->seed;
+	st->total = 0;
+	st->buffered = 0;
+	memset(st->last, 0, sizeof(st->last));
+}
+
+/*
+ * Every complete block is hashed as soon as it is available, as the
+ * one-shot path hashes all len / 48 of them. Only the last 16 bytes of
+ * the latest block are kept for the final overlapping read.
+ */
+void
+hash_update(hash_state_t *st, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+
+	st->total += len;
+
+	if (st->buffered)
+	{
+		size_t room = 48 - st->buffered;
+
+		if (len < room)
+		{
+			memcpy(st->buf + st->buffered, p, len);
+			st->buffered += (uint32_t)len;
+			return;
+		}
+		memcpy(st->buf + st->buffered, p, room);
+		hash_blocks(st->lane, st->buf, 1);
+		memcpy(st->last, st->buf + 32, 16);
+		st->buffered = 0;
+		p += room;
+		len -= room;
+	}
+
+	if (len >= 48)
+	{
+		size_t nblocks = len / 48;
+
+		hash_blocks(st->lane, p, nblocks);
+		p += nblocks * 48;
+		len -= nblocks * 48;
+		memcpy(st->last, p - 16, 16);
+	}
+
+	if (len)
+	{
+		memcpy(st->buf, p, len);
+		st->buffered = (uint32_t)len;
+	}
+}
+
+static hash128_t
+hash_final(const hash_state_t *st, int wide)
+{
+	uint8_t tail[16 + 48];
+
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_HASHES);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, st->total);
+
+	if (st->total <= 16)
+	{
+		uint64_t a, b;
+
+		hash_read_short(st->buf, st->buffered, &a, &b);
+		return hash_finish(a, b, st->total, st->seed,
+				   wide ? hash_fold_hi(st->lane) : 0, wide);
+	}
+
+	/* Rebuild the input as hash_tail() sees it in the one-shot path */
+	memcpy(tail, st->last, 16);
+	memcpy(tail + 16, st->buf, st->buffered);
+	return hash_tail(tail + 16, st->buffered, st->total, hash_fold_lo(st->lane),
+			 wide ? hash_fold_hi(st->lane) : 0, wide);
+}
+
+uint64_t
+hash_final64(const hash_state_t *st)
+{
+	return hash_final(st, 0).lo;
+}
+
+hash128_t
+hash_final128(const hash_state_t *st)
+{
+	return hash_final(st, 1);
+}
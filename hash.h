@@ -18,4 +18,96 @@
  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
- */
\ No newline at end of file
+ */
+
+#ifndef __NOSHIRO_HASH_H__
+#define __NOSHIRO_HASH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fast non-cryptographic hashing for hash tables, filters and checksums,
+ * in the style of wyhash: 64x64->128 bit multiply-and-fold mixing, three
+ * independent lanes over 48-byte blocks for long inputs and branch-light
+ * overlapping reads for short ones.
+ *
+ * Results depend only on the bytes, length and seed; they are the same on
+ * every platform and across one-shot and streaming calls, and may be
+ * stored. They are not suitable where an attacker picks the keys and can
+ * observe the hashes; use md5/sha for content addressing.
+ */
+
+typedef struct {
+	uint64_t lo;
+	uint64_t hi;
+} hash128_t;
+
+/**
+ * @param data bytes to hash, may be NULL when len is 0
+ * @param len  number of bytes
+ * @param seed selects an independent hash function
+ * @return     64-bit hash
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+/**
+ * 128-bit hash with a 128-bit chaining state for long inputs, for dedup
+ * keys and checksums where 64 bits collide too soon. The lo half equals
+ * hash64() of the same input and seed.
+ */
+hash128_t hash128(const void *data, size_t len, uint64_t seed);
+
+/**
+ * Fast paths for fixed-size integer keys. They equal hash64() over the
+ * little-endian bytes of the key.
+ */
+uint64_t hash_u32(uint32_t key, uint64_t seed);
+uint64_t hash_u64(uint64_t key, uint64_t seed);
+
+/**
+ * Full 64x64 -> 128 bit product, with a portable fallback where the
+ * compiler has no __int128. The high half alone maps a hash onto [0, n)
+ * without a division: hash_mul128(h, n, &lo, &hi) leaves hi < n.
+ */
+static inline void
+hash_mul128(uint64_t a, uint64_t b, uint64_t *lo, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r = (unsigned __int128)a * b;
+
+	*lo = (uint64_t)r;
+	*hi = (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl, l = t + (rm1 << 32);
+
+	c += l < t;
+	*lo = l;
+	*hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/* Streaming state; the fields are private */
+typedef struct {
+	uint64_t seed;     /* seed after premixing */
+	uint64_t lane[3];  /* block lanes */
+	uint64_t total;    /* bytes hashed so far */
+	uint8_t buf[48];   /* pending input, less than a block */
+	uint8_t last[16];  /* last 16 bytes of the previous block */
+	uint32_t buffered; /* bytes in buf */
+} hash_state_t;
+
+/**
+ * Streaming interface: hash_init(), any number of hash_update() calls and
+ * hash_final64()/hash_final128() give the same result as hash64() /
+ * hash128() over the concatenated input. Finalizing does not modify the
+ * state, so more data can be appended afterwards.
+ */
+void hash_init(hash_state_t *st, uint64_t seed);
+void hash_update(hash_state_t *st, const void *data, size_t len);
+uint64_t hash_final64(const hash_state_t *st);
+hash128_t hash_final128(const hash_state_t *st);
+
+#endif /* __NOSHIRO_HASH_H__ */
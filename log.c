@@ -1,4 +1,3 @@
-#include "log.h"
 /**
  * Copyright (c) 2023-present Merlot.Rain
  *
@@ -22,11 +21,42 @@
  */
 
 #include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #define LW_MSG_MAXLEN 256
 
-static log_level_t default_loglevel = debug;
+#define LWLOG_BATCH_SIZE    65536 /* bytes handed to one write() */
+#define LWLOG_IDLE_WAIT_NS  10000000L
+#define LWLOG_CACHE_LINE    64
+
+_Atomic int lwlog_levels[LWLOG_CAT_COUNT] = {
+    [0 ... LWLOG_CAT_COUNT - 1] = debug,
+};
+
+static const char *lwlog_category_names[LWLOG_CAT_COUNT] = {
+    [LWLOG_CAT_DEFAULT] = "default",
+    [LWLOG_CAT_SDS] = "sds",
+    [LWLOG_CAT_SDA] = "sda",
+    [LWLOG_CAT_BITSET] = "bitset",
+    [LWLOG_CAT_HASH] = "hash",
+    [LWLOG_CAT_UUID] = "uuid",
+    [LWLOG_CAT_IO] = "io",
+};
 
 static void default_noticereporter(const char *fmt, va_list ap);
 static void default_errorreporter(const char *fmt, va_list ap);
@@ -35,6 +65,1142 @@ lwreporter lwnotice_var = default_noticereporter;
 lwreporter lwerror_var = default_errorreporter;
 lwdebuglogger lwdebug_var = default_debuglogger;
 
+/*
+ * Asynchronous sink.
+ *
+ * A bounded multi-producer ring (Vyukov's queue): each slot carries a
+ * sequence number telling whether it is free for the producer at position
+ * pos (seq == pos) or holds the message for the consumer (seq == pos + 1).
+ * Producers claim positions with a CAS on head and format straight into
+ * the slot; the single background thread copies finished messages into a
+ * batch buffer and writes it out once it is full or the ring runs dry.
+ */
+enum
+{
+	LWLOG_TEXT,  ///< msg holds formatted text
+	LWLOG_RECORD ///< msg holds an encoded binary record
+};
+
+typedef struct {
+	_Atomic size_t seq;
+	uint16_t len;
+	uint8_t kind;
+	char msg[LW_MSG_MAXLEN + 1];
+} lwlog_slot;
+
+typedef struct {
+	lwlog_slot *slots;
+	size_t mask;
+	_Alignas(LWLOG_CACHE_LINE) _Atomic size_t head; /* next position to claim */
+	_Alignas(LWLOG_CACHE_LINE) size_t tail;         /* consumer only */
+	_Atomic size_t written;                          /* positions written out */
+	_Atomic int sleeping;
+	_Atomic uint64_t dropped;
+	lwlog_overflow_t policy;
+	int fd;
+	bool stopping;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t flushed;
+} lwlog_ring;
+
+static lwlog_ring lwlog_async;
+static _Atomic(lwlog_ring *) lwlog_active;
+static pthread_mutex_t lwlog_control = PTHREAD_MUTEX_INITIALIZER;
+static char lwlog_batch[LWLOG_BATCH_SIZE];
+
+static size_t lwlog_render(const void *rec, size_t len, int pad, char *out, size_t cap);
+static void lwlog_flight_site(const lwlog_site_t *site, uint32_t id);
+static bool lwlog_flight_text(int level, const char *fmt, va_list ap);
+static bool lwlog_flight_record(int level, uint32_t id, const lwlog_arg_t *args, size_t nargs);
+
+static void
+lwlog_write_all(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
+static void
+lwlog_wake(lwlog_ring *r)
+{
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_signal(&r->wake);
+	pthread_mutex_unlock(&r->lock);
+}
+
+/* Move every published message into the batch buffer and write it out.
+ * Returns false if the ring was empty. */
+static bool
+lwlog_drain(lwlog_ring *r)
+{
+	size_t used = 0;
+	bool any = false;
+
+	for (;;)
+	{
+		lwlog_slot *slot = &r->slots[r->tail & r->mask];
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != r->tail + 1)
+			break;
+
+		if (used + LW_MSG_MAXLEN + 1 > LWLOG_BATCH_SIZE)
+		{
+			lwlog_write_all(r->fd, lwlog_batch, used);
+			used = 0;
+		}
+		if (slot->kind == LWLOG_RECORD)
+		{
+			used += lwlog_render(slot->msg, slot->len, 1, lwlog_batch + used, LW_MSG_MAXLEN + 1);
+		}
+		else
+		{
+			memcpy(lwlog_batch + used, slot->msg, slot->len);
+			used += slot->len;
+		}
+		lwlog_batch[used++] = '\n';
+
+		/* Hand the slot to the producer one lap ahead */
+		atomic_store_explicit(&slot->seq, r->tail + r->mask + 1, memory_order_release);
+		r->tail++;
+		any = true;
+	}
+
+	if (used)
+		lwlog_write_all(r->fd, lwlog_batch, used);
+	if (any)
+	{
+		atomic_store_explicit(&r->written, r->tail, memory_order_release);
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_broadcast(&r->flushed);
+		pthread_mutex_unlock(&r->lock);
+	}
+	return any;
+}
+
+static void *
+lwlog_consumer(void *arg)
+{
+	lwlog_ring *r = (lwlog_ring *)arg;
+
+	for (;;)
+	{
+		if (lwlog_drain(r))
+			continue;
+
+		pthread_mutex_lock(&r->lock);
+		if (r->stopping)
+		{
+			pthread_mutex_unlock(&r->lock);
+			break;
+		}
+		/* Producers only signal when they see this flag; the timeout
+		 * bounds the delay of a wakeup lost to the race in between */
+		atomic_store(&r->sleeping, 1);
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LWLOG_IDLE_WAIT_NS;
+		if (ts.tv_nsec >= 1000000000L)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&r->wake, &r->lock, &ts);
+		atomic_store(&r->sleeping, 0);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	lwlog_drain(r);
+	return NULL;
+}
+
+/* Claim a slot, or NULL when the message must be dropped */
+static lwlog_slot *
+lwlog_claim(lwlog_ring *r, size_t *pos)
+{
+	size_t p = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	for (;;)
+	{
+		lwlog_slot *slot = &r->slots[p & r->mask];
+		size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)p;
+
+		if (diff == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(
+				&r->head, &p, p + 1, memory_order_relaxed, memory_order_relaxed))
+			{
+				*pos = p;
+				return slot;
+			}
+		}
+		else if (diff < 0)
+		{
+			/* Full */
+			if (r->policy == LWLOG_DROP)
+			{
+				atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+				return NULL;
+			}
+			if (atomic_load_explicit(&lwlog_active, memory_order_relaxed) != r)
+			{
+				/* Stopped while we waited: nobody will make room */
+				atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+				return NULL;
+			}
+			lwlog_wake(r);
+			sched_yield();
+			p = atomic_load_explicit(&r->head, memory_order_relaxed);
+		}
+		else
+		{
+			p = atomic_load_explicit(&r->head, memory_order_relaxed);
+		}
+	}
+}
+
+static void
+lwlog_publish(lwlog_ring *r, lwlog_slot *slot, size_t pos)
+{
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	if (atomic_load_explicit(&r->sleeping, memory_order_relaxed))
+		lwlog_wake(r);
+}
+
+/* Format a message into the async ring, or write it out directly when the
+ * sink is not running. `pad` leading spaces are added before the text. */
+static void
+lwlog_emit(int pad, const char *fmt, va_list ap)
+{
+	lwlog_ring *r = atomic_load_explicit(&lwlog_active, memory_order_acquire);
+	char local[LW_MSG_MAXLEN + 1];
+	lwlog_slot *slot = NULL;
+	size_t pos = 0;
+	char *msg = local;
+
+	if (r != NULL && (slot = lwlog_claim(r, &pos)) == NULL)
+		return;
+	if (slot != NULL)
+		msg = slot->msg;
+
+	int i;
+	for (i = 0; i < pad && i < LW_MSG_MAXLEN; i++)
+		msg[i] = ' ';
+	int n = vsnprintf(msg + i, LW_MSG_MAXLEN - i, fmt, ap);
+	msg[LW_MSG_MAXLEN] = '\0';
+	size_t len = (size_t)i;
+	if (n > 0)
+		len += (size_t)n < (size_t)(LW_MSG_MAXLEN - i) ? (size_t)n
+								  : (size_t)(LW_MSG_MAXLEN - i - 1);
+
+	if (slot != NULL)
+	{
+		slot->len = (uint16_t)len;
+		slot->kind = LWLOG_TEXT;
+		lwlog_publish(r, slot, pos);
+	}
+	else
+	{
+		fprintf(stderr, "%s\n", msg);
+	}
+}
+
+/* ---------------------------- binary records ---------------------------- */
+
+/*
+ * Record layout (host byte order, at most LW_MSG_MAXLEN bytes):
+ *   u64 timestamp (ns, CLOCK_REALTIME), u32 site id, u8 nargs, u8 reserved,
+ *   u16 size, then per argument a u8 type followed by 8 value bytes, or for
+ *   strings a u16 length and the bytes including the terminating NUL.
+ */
+#define LWLOG_RECORD_HEADER 16
+#define LWLOG_SITE_CHUNK    256
+#define LWLOG_SITE_CHUNKS   256
+
+/* Sites by id, in lazily allocated chunks so lookups need no lock */
+static _Atomic(lwlog_site_t **) lwlog_sites[LWLOG_SITE_CHUNKS];
+static uint32_t lwlog_site_next = 1;
+static pthread_mutex_t lwlog_site_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The id of a site, registering it on first use; 0 if the table is full */
+static uint32_t
+lwlog_site_id(lwlog_site_t *site)
+{
+	uint32_t id = atomic_load_explicit(&site->id, memory_order_acquire);
+	if (id != 0)
+		return id;
+
+	pthread_mutex_lock(&lwlog_site_lock);
+	id = atomic_load_explicit(&site->id, memory_order_relaxed);
+	if (id == 0 && lwlog_site_next < LWLOG_SITE_CHUNK * LWLOG_SITE_CHUNKS)
+	{
+		size_t c = lwlog_site_next / LWLOG_SITE_CHUNK;
+		lwlog_site_t **chunk = atomic_load_explicit(&lwlog_sites[c], memory_order_relaxed);
+		if (chunk == NULL)
+		{
+			chunk = (lwlog_site_t **)calloc(LWLOG_SITE_CHUNK, sizeof(lwlog_site_t *));
+			atomic_store_explicit(&lwlog_sites[c], chunk, memory_order_release);
+		}
+		if (chunk != NULL)
+		{
+			id = lwlog_site_next++;
+			chunk[id % LWLOG_SITE_CHUNK] = site;
+			lwlog_flight_site(site, id);
+			atomic_store_explicit(&site->id, id, memory_order_release);
+		}
+	}
+	pthread_mutex_unlock(&lwlog_site_lock);
+	return id;
+}
+
+const lwlog_site_t *
+lwlog_site_get(uint32_t id)
+{
+	if (id == 0 || id >= LWLOG_SITE_CHUNK * LWLOG_SITE_CHUNKS)
+		return NULL;
+
+	lwlog_site_t **chunk =
+	    atomic_load_explicit(&lwlog_sites[id / LWLOG_SITE_CHUNK], memory_order_acquire);
+	return chunk ? chunk[id % LWLOG_SITE_CHUNK] : NULL;
+}
+
+static size_t
+lwlog_encode(char *buf, uint32_t id, const lwlog_arg_t *args, size_t nargs)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t now = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+	size_t used = LWLOG_RECORD_HEADER;
+	size_t n;
+
+	for (n = 0; n < nargs && n < LWLOG_MAX_ARGS; n++)
+	{
+		if (args[n].type == LWLOG_ARG_STR)
+		{
+			const char *str = args[n].v.s ? args[n].v.s : "(null)";
+			if (used + 4 > LW_MSG_MAXLEN)
+				break;
+			size_t room = LW_MSG_MAXLEN - used - 4;
+			size_t slen = strnlen(str, room);
+			uint16_t len16 = (uint16_t)(slen + 1);
+			buf[used] = LWLOG_ARG_STR;
+			memcpy(buf + used + 1, &len16, 2);
+			memcpy(buf + used + 3, str, slen);
+			buf[used + 3 + slen] = '\0';
+			used += 3 + slen + 1;
+		}
+		else
+		{
+			if (used + 9 > LW_MSG_MAXLEN)
+				break;
+			buf[used] = (char)args[n].type;
+			memcpy(buf + used + 1, &args[n].v, 8);
+			used += 9;
+		}
+	}
+
+	uint8_t nargs8 = (uint8_t)n, reserved = 0;
+	uint16_t size16 = (uint16_t)used;
+	memcpy(buf, &now, 8);
+	memcpy(buf + 8, &id, 4);
+	memcpy(buf + 12, &nargs8, 1);
+	memcpy(buf + 13, &reserved, 1);
+	memcpy(buf + 14, &size16, 2);
+	return used;
+}
+
+/* Unpack the arguments of a record; strings point into it */
+static size_t
+lwlog_decode_args(const char *rec, size_t len, lwlog_arg_t *args)
+{
+	size_t nargs = (uint8_t)rec[12];
+	size_t off = LWLOG_RECORD_HEADER;
+	size_t n;
+
+	for (n = 0; n < nargs && n < LWLOG_MAX_ARGS && off < len; n++)
+	{
+		args[n].type = (uint8_t)rec[off];
+		if (args[n].type == LWLOG_ARG_STR)
+		{
+			uint16_t slen;
+			if (off + 3 > len)
+				break;
+			memcpy(&slen, rec + off + 1, 2);
+			if (slen == 0 || off + 3 + slen > len)
+				break;
+			args[n].v.s = rec + off + 3;
+			off += 3 + slen;
+		}
+		else
+		{
+			if (off + 9 > len)
+				break;
+			memcpy(&args[n].v, rec + off + 1, 8);
+			off += 9;
+		}
+	}
+	return n;
+}
+
+enum
+{
+	LWLOG_LEN_NONE,
+	LWLOG_LEN_HH,
+	LWLOG_LEN_H,
+	LWLOG_LEN_L,
+	LWLOG_LEN_LL,
+	LWLOG_LEN_Z,
+	LWLOG_LEN_J,
+	LWLOG_LEN_T,
+	LWLOG_LEN_BIG_L
+};
+
+static int64_t
+lwlog_arg_as_int(const lwlog_arg_t *a)
+{
+	switch (a->type)
+	{
+	case LWLOG_ARG_INT:
+		return a->v.i;
+	case LWLOG_ARG_UINT:
+		return (int64_t)a->v.u;
+	case LWLOG_ARG_DOUBLE:
+		return (int64_t)a->v.d;
+	case LWLOG_ARG_PTR:
+		return (int64_t)(intptr_t)a->v.p;
+	default:
+		return 0;
+	}
+}
+
+static double
+lwlog_arg_as_double(const lwlog_arg_t *a)
+{
+	switch (a->type)
+	{
+	case LWLOG_ARG_INT:
+		return (double)a->v.i;
+	case LWLOG_ARG_UINT:
+		return (double)a->v.u;
+	case LWLOG_ARG_DOUBLE:
+		return a->v.d;
+	default:
+		return 0.0;
+	}
+}
+
+/* Format one conversion, passing the value with the C type `spec` expects */
+static int
+lwlog_format_arg(char *out, size_t cap, const char *spec, int lenmod, char conv, const lwlog_arg_t *a)
+{
+	int64_t i = lwlog_arg_as_int(a);
+
+	switch (conv)
+	{
+	case 'd':
+	case 'i':
+		switch (lenmod)
+		{
+		case LWLOG_LEN_L:
+			return snprintf(out, cap, spec, (long)i);
+		case LWLOG_LEN_LL:
+			return snprintf(out, cap, spec, (long long)i);
+		case LWLOG_LEN_Z:
+		case LWLOG_LEN_T:
+			return snprintf(out, cap, spec, (ptrdiff_t)i);
+		case LWLOG_LEN_J:
+			return snprintf(out, cap, spec, (intmax_t)i);
+		default:
+			return snprintf(out, cap, spec, (int)i);
+		}
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		switch (lenmod)
+		{
+		case LWLOG_LEN_L:
+			return snprintf(out, cap, spec, (unsigned long)i);
+		case LWLOG_LEN_LL:
+			return snprintf(out, cap, spec, (unsigned long long)i);
+		case LWLOG_LEN_Z:
+		case LWLOG_LEN_T:
+			return snprintf(out, cap, spec, (size_t)i);
+		case LWLOG_LEN_J:
+			return snprintf(out, cap, spec, (uintmax_t)i);
+		default:
+			return snprintf(out, cap, spec, (unsigned int)i);
+		}
+	case 'c':
+		return snprintf(out, cap, spec, (int)i);
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		if (lenmod == LWLOG_LEN_BIG_L)
+			return snprintf(out, cap, spec, (long double)lwlog_arg_as_double(a));
+		return snprintf(out, cap, spec, lwlog_arg_as_double(a));
+	case 's':
+		return snprintf(out, cap, spec, a->type == LWLOG_ARG_STR ? a->v.s : "(?)");
+	case 'p':
+		return snprintf(out, cap, spec, a->type == LWLOG_ARG_PTR ? a->v.p : (const void *)(intptr_t)i);
+	default:
+		return snprintf(out, cap, "%s", spec);
+	}
+}
+
+/* printf() over decoded arguments, one conversion at a time */
+static size_t
+lwlog_format_args(const char *fmt, const lwlog_arg_t *args, size_t nargs, char *out, size_t cap)
+{
+	size_t used = 0;
+	size_t next = 0;
+	const char *p = fmt;
+
+#define LWLOG_ADVANCE(n) \
+	used += (n) < 0 ? 0 : (size_t)(n) < cap - used ? (size_t)(n) : cap - used - 1
+
+	while (*p && used + 1 < cap)
+	{
+		if (*p != '%' || p[1] == '%')
+		{
+			out[used++] = *p;
+			p += *p == '%' ? 2 : 1;
+			continue;
+		}
+
+		const char *start = p++;
+		while (*p && strchr("-+ #0'", *p))
+			p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		if (*p == '.')
+		{
+			p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+
+		int lenmod = LWLOG_LEN_NONE;
+		switch (*p)
+		{
+		case 'h':
+			lenmod = p[1] == 'h' ? LWLOG_LEN_HH : LWLOG_LEN_H;
+			p += p[1] == 'h' ? 2 : 1;
+			break;
+		case 'l':
+			lenmod = p[1] == 'l' ? LWLOG_LEN_LL : LWLOG_LEN_L;
+			p += p[1] == 'l' ? 2 : 1;
+			break;
+		case 'q':
+			lenmod = LWLOG_LEN_LL;
+			p++;
+			break;
+		case 'z':
+			lenmod = LWLOG_LEN_Z;
+			p++;
+			break;
+		case 'j':
+			lenmod = LWLOG_LEN_J;
+			p++;
+			break;
+		case 't':
+			lenmod = LWLOG_LEN_T;
+			p++;
+			break;
+		case 'L':
+			lenmod = LWLOG_LEN_BIG_L;
+			p++;
+			break;
+		}
+		if (*p == '\0')
+			break;
+
+		char conv = *p++;
+		char spec[32];
+		size_t speclen = (size_t)(p - start);
+		if (speclen >= sizeof(spec) || conv == 'n' || next >= nargs)
+		{
+			/* Unsupported or missing argument: print it verbatim */
+			int n = snprintf(out + used, cap - used, "%.*s", (int)speclen, start);
+			LWLOG_ADVANCE(n);
+			continue;
+		}
+		memcpy(spec, start, speclen);
+		spec[speclen] = '\0';
+
+		int n = lwlog_format_arg(out + used, cap - used, spec, lenmod, conv, &args[next++]);
+		LWLOG_ADVANCE(n);
+	}
+#undef LWLOG_ADVANCE
+
+	out[used] = '\0';
+	return used;
+}
+
+/* The text of a record: optional level padding, the call site, the message */
+static size_t
+lwlog_render_site(const lwlog_site_t *site, const void *rec, size_t len, int pad, char *out, size_t cap)
+{
+	const char *r = (const char *)rec;
+	lwlog_arg_t args[LWLOG_MAX_ARGS];
+	uint32_t id;
+
+	if (cap == 0)
+		return 0;
+	out[0] = '\0';
+	if (len < LWLOG_RECORD_HEADER)
+		return 0;
+
+	memcpy(&id, r + 8, 4);
+	if (site == NULL)
+	{
+		int n = snprintf(out, cap, "[unknown log site %u]", id);
+		return n < 0 ? 0 : (size_t)n < cap ? (size_t)n : cap - 1;
+	}
+
+	size_t used = 0;
+	if (pad)
+	{
+		for (; used < (size_t)site->level && used + 1 < cap; used++)
+			out[used] = ' ';
+	}
+	int n = snprintf(out + used, cap - used, "[%s:%s:%d] ", site->file, site->func, site->line);
+	used += n < 0 ? 0 : (size_t)n < cap - used ? (size_t)n : cap - used - 1;
+
+	size_t nargs = lwlog_decode_args(r, len, args);
+	return used + lwlog_format_args(site->fmt, args, nargs, out + used, cap - used);
+}
+
+static size_t
+lwlog_render(const void *rec, size_t len, int pad, char *out, size_t cap)
+{
+	uint32_t id = 0;
+	if (len >= LWLOG_RECORD_HEADER)
+		memcpy(&id, (const char *)rec + 8, 4);
+	return lwlog_render_site(lwlog_site_get(id), rec, len, pad, out, cap);
+}
+
+size_t
+lwlog_record_format(const void *rec, size_t len, char *out, size_t cap)
+{
+	return lwlog_render(rec, len, 1, out, cap);
+}
+
+void
+lwlog_binary(lwlog_site_t *site, const lwlog_arg_t *args, size_t nargs)
+{
+	uint32_t id = lwlog_site_id(site);
+	if (id != 0 && lwlog_flight_record(site->level, id, args, nargs))
+		return;
+
+	lwlog_ring *r = atomic_load_explicit(&lwlog_active, memory_order_acquire);
+
+	if (id != 0 && r != NULL && lwdebug_var == default_debuglogger)
+	{
+		size_t pos;
+		lwlog_slot *slot = lwlog_claim(r, &pos);
+		if (slot == NULL)
+			return;
+		slot->len = (uint16_t)lwlog_encode(slot->msg, id, args, nargs);
+		slot->kind = LWLOG_RECORD;
+		lwlog_publish(r, slot, pos);
+		return;
+	}
+
+	/* Format right away, through the installed debug logger */
+	char text[LW_MSG_MAXLEN + 1];
+	if (id != 0)
+	{
+		char rec[LW_MSG_MAXLEN];
+		size_t len = lwlog_encode(rec, id, args, nargs);
+		lwlog_render(rec, len, 0, text, sizeof(text));
+	}
+	else
+	{
+		/* Site table full: skip the record, keep the message */
+		int n = snprintf(text, sizeof(text), "[%s:%s:%d] ", site->file, site->func, site->line);
+		size_t used = n < 0 ? 0 : (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1;
+		lwlog_format_args(site->fmt, args, nargs < LWLOG_MAX_ARGS ? nargs : LWLOG_MAX_ARGS,
+				  text + used, sizeof(text) - used);
+	}
+	lwdebugc((lwlog_category_t)site->category, site->level, "%s", text);
+}
+
+/* ---------------------------- flight recorder ---------------------------- */
+
+/*
+ * File layout (host byte order and struct layout; decode on the same
+ * architecture):
+ *   header  lwlog_flight_header, padded to LWLOG_FLIGHT_HEADER bytes
+ *   sites   LWLOG_FLIGHT_SITES entries of LWLOG_FLIGHT_SITE_SIZE bytes,
+ *           indexed by site id
+ *   rings   one per thread: a LWLOG_FLIGHT_RING_HEADER byte header, then
+ *           `slots` lwlog_flight_slot
+ *
+ * A slot is invalidated (seq = 0) before it is overwritten and gets its
+ * sequence number back only once complete, so a crash mid-write leaves
+ * at most one slot that the decoder skips.
+ */
+#define LWLOG_FLIGHT_MAGIC       "NSHFLT01"
+#define LWLOG_FLIGHT_VERSION     1
+#define LWLOG_FLIGHT_HEADER      4096
+#define LWLOG_FLIGHT_SITES       4096
+#define LWLOG_FLIGHT_SITE_SIZE   256
+#define LWLOG_FLIGHT_SITE_FIXED  20
+#define LWLOG_FLIGHT_RING_HEADER 64
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t threads;   /* rings in the file */
+	uint32_t slots;     /* slots per ring */
+	uint32_t slot_size; /* sizeof(lwlog_flight_slot) */
+	_Atomic uint32_t threads_used;
+} lwlog_flight_header;
+
+typedef struct {
+	uint32_t id; /* written last; 0 for an unused entry */
+	int32_t line;
+	int32_t level;
+	uint16_t file_len; /* the strings follow, each NUL terminated */
+	uint16_t func_len;
+	uint16_t fmt_len;
+	uint16_t reserved;
+} lwlog_flight_site_entry;
+
+typedef struct {
+	uint64_t tid;
+	uint64_t next; /* sequence number of the next record */
+} lwlog_flight_ring;
+
+typedef struct {
+	_Atomic uint32_t seq; /* 1 + position in the ring's history; 0 if invalid */
+	uint16_t len;
+	uint8_t kind; /* LWLOG_TEXT or LWLOG_RECORD */
+	uint8_t level;
+	uint32_t tid;
+	uint32_t reserved;
+	uint64_t ts; /* ns, CLOCK_REALTIME */
+	char data[LW_MSG_MAXLEN];
+} lwlog_flight_slot;
+
+static char *lwlog_flight_map;
+static size_t lwlog_flight_size;
+static _Atomic int lwlog_flight_on;
+static _Thread_local lwlog_flight_ring *lwlog_flight_local;
+static _Thread_local bool lwlog_flight_none; /* no ring left for this thread */
+
+#define lwlog_flight_hdr(map) ((lwlog_flight_header *)(void *)(map))
+#define lwlog_flight_site_at(map, id) \
+	((map) + LWLOG_FLIGHT_HEADER + (size_t)(id) * LWLOG_FLIGHT_SITE_SIZE)
+#define lwlog_flight_ring_size(h) \
+	(LWLOG_FLIGHT_RING_HEADER + (size_t)(h)->slots * sizeof(lwlog_flight_slot))
+#define lwlog_flight_ring_at(map, h, i) \
+	((lwlog_flight_ring *)(void *)((map) + LWLOG_FLIGHT_HEADER + \
+				       LWLOG_FLIGHT_SITES * LWLOG_FLIGHT_SITE_SIZE + \
+				       (size_t)(i) * lwlog_flight_ring_size(h)))
+#define lwlog_flight_slot_at(ring, i) \
+	((lwlog_flight_slot *)(void *)((char *)(ring) + LWLOG_FLIGHT_RING_HEADER) + (i))
+
+static uint64_t
+lwlog_flight_tid(void)
+{
+#ifdef __linux__
+	return (uint64_t)syscall(SYS_gettid);
+#else
+	return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+/* Copy a site into the file; called with lwlog_site_lock held */
+static void
+lwlog_flight_site(const lwlog_site_t *site, uint32_t id)
+{
+	char *map = lwlog_flight_map;
+	if (map == NULL || id >= LWLOG_FLIGHT_SITES)
+		return;
+
+	char *entry = lwlog_flight_site_at(map, id);
+	size_t room = LWLOG_FLIGHT_SITE_SIZE - LWLOG_FLIGHT_SITE_FIXED;
+	const char *strs[3] = {site->file, site->func, site->fmt};
+	uint16_t lens[3];
+	char *p = entry + LWLOG_FLIGHT_SITE_FIXED;
+
+	for (int i = 0; i < 3; i++)
+	{
+		/* leave room for this terminator and those of the later strings */
+		size_t n = strnlen(strs[i], room - (size_t)(3 - i));
+		memcpy(p, strs[i], n);
+		p[n] = '\0';
+		p += n + 1;
+		room -= n + 1;
+		lens[i] = (uint16_t)n;
+	}
+
+	lwlog_flight_site_entry e = {0, site->line, site->level, lens[0], lens[1], lens[2], 0};
+	memcpy(entry, &e, sizeof(e));
+	atomic_store_explicit((_Atomic uint32_t *)(void *)entry, id, memory_order_release);
+}
+
+/* Invalidate and return the next slot of the calling thread's ring */
+static lwlog_flight_slot *
+lwlog_flight_claim(uint64_t *seq)
+{
+	if (!atomic_load_explicit(&lwlog_flight_on, memory_order_acquire) || lwlog_flight_none)
+		return NULL;
+
+	lwlog_flight_header *h = lwlog_flight_hdr(lwlog_flight_map);
+	lwlog_flight_ring *ring = lwlog_flight_local;
+	if (ring == NULL)
+	{
+		uint32_t i = atomic_fetch_add(&h->threads_used, 1);
+		if (i >= h->threads)
+		{
+			lwlog_flight_none = true;
+			return NULL;
+		}
+		ring = lwlog_flight_ring_at(lwlog_flight_map, h, i);
+		ring->tid = lwlog_flight_tid();
+		lwlog_flight_local = ring;
+	}
+
+	*seq = ++ring->next;
+	lwlog_flight_slot *slot = lwlog_flight_slot_at(ring, (*seq - 1) % h->slots);
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->tid = (uint32_t)ring->tid;
+	return slot;
+}
+
+static void
+lwlog_flight_commit(lwlog_flight_slot *slot, uint64_t seq, int kind, int level, size_t len)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	slot->ts = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+	slot->len = (uint16_t)len;
+	slot->kind = (uint8_t)kind;
+	slot->level = (uint8_t)level;
+	atomic_store_explicit(&slot->seq, (uint32_t)seq, memory_order_release);
+}
+
+static bool
+lwlog_flight_text(int level, const char *fmt, va_list ap)
+{
+	uint64_t seq;
+	lwlog_flight_slot *slot = lwlog_flight_claim(&seq);
+	if (slot == NULL)
+		return false;
+
+	int n = vsnprintf(slot->data, LW_MSG_MAXLEN, fmt, ap);
+	size_t len = n < 0 ? 0 : (size_t)n < LW_MSG_MAXLEN ? (size_t)n : LW_MSG_MAXLEN - 1;
+	lwlog_flight_commit(slot, seq, LWLOG_TEXT, level, len);
+	return true;
+}
+
+static bool
+lwlog_flight_record(int level, uint32_t id, const lwlog_arg_t *args, size_t nargs)
+{
+	uint64_t seq;
+	lwlog_flight_slot *slot = lwlog_flight_claim(&seq);
+	if (slot == NULL)
+		return false;
+
+	size_t len = lwlog_encode(slot->data, id, args, nargs);
+	lwlog_flight_commit(slot, seq, LWLOG_RECORD, level, len);
+	return true;
+}
+
+int
+lwlog_flight_start(const char *path, size_t threads, size_t records)
+{
+	int rc = -1;
+
+	pthread_mutex_lock(&lwlog_control);
+	if (lwlog_flight_map != NULL || threads == 0 || records == 0 ||
+	    threads > UINT32_MAX || records > UINT32_MAX)
+		goto done;
+
+	size_t size = LWLOG_FLIGHT_HEADER + LWLOG_FLIGHT_SITES * LWLOG_FLIGHT_SITE_SIZE +
+		      threads * (LWLOG_FLIGHT_RING_HEADER + records * sizeof(lwlog_flight_slot));
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto done;
+	if (ftruncate(fd, (off_t)size) != 0)
+	{
+		close(fd);
+		goto done;
+	}
+	char *map = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		goto done;
+
+	lwlog_flight_header *h = lwlog_flight_hdr(map);
+	memcpy(h->magic, LWLOG_FLIGHT_MAGIC, 8);
+	h->version = LWLOG_FLIGHT_VERSION;
+	h->threads = (uint32_t)threads;
+	h->slots = (uint32_t)records;
+	h->slot_size = sizeof(lwlog_flight_slot);
+	atomic_init(&h->threads_used, 0);
+
+	/* Sites registered before now, then every new one as it appears */
+	pthread_mutex_lock(&lwlog_site_lock);
+	lwlog_flight_map = map;
+	lwlog_flight_size = size;
+	for (uint32_t id = 1; id < lwlog_site_next && id < LWLOG_FLIGHT_SITES; id++)
+		lwlog_flight_site(lwlog_site_get(id), id);
+	pthread_mutex_unlock(&lwlog_site_lock);
+
+	atomic_store_explicit(&lwlog_flight_on, 1, memory_order_release);
+	rc = 0;
+
+done:
+	pthread_mutex_unlock(&lwlog_control);
+	return rc;
+}
+
+void
+lwlog_flight_stop(void)
+{
+	pthread_mutex_lock(&lwlog_control);
+	if (lwlog_flight_map != NULL && atomic_exchange(&lwlog_flight_on, 0))
+		msync(lwlog_flight_map, lwlog_flight_size, MS_SYNC);
+	pthread_mutex_unlock(&lwlog_control);
+}
+
+static int
+lwlog_flight_compare(const void *a, const void *b)
+{
+	const lwlog_flight_slot *x = *(const lwlog_flight_slot *const *)a;
+	const lwlog_flight_slot *y = *(const lwlog_flight_slot *const *)b;
+
+	if (x->ts != y->ts)
+		return x->ts < y->ts ? -1 : 1;
+	if (x->tid != y->tid)
+		return x->tid < y->tid ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+int
+lwlog_flight_decode(const char *path, FILE *out)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < LWLOG_FLIGHT_HEADER)
+	{
+		close(fd);
+		return -1;
+	}
+	size_t size = (size_t)st.st_size;
+	char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	int rc = -1;
+	const lwlog_flight_slot **slots = NULL;
+	lwlog_flight_header *h = lwlog_flight_hdr(map);
+	if (size < LWLOG_FLIGHT_HEADER + LWLOG_FLIGHT_SITES * LWLOG_FLIGHT_SITE_SIZE ||
+	    memcmp(h->magic, LWLOG_FLIGHT_MAGIC, 8) != 0 ||
+	    h->version != LWLOG_FLIGHT_VERSION ||
+	    h->slot_size != sizeof(lwlog_flight_slot) || h->slots == 0 ||
+	    (size - LWLOG_FLIGHT_HEADER - LWLOG_FLIGHT_SITES * LWLOG_FLIGHT_SITE_SIZE) /
+		    lwlog_flight_ring_size(h) < h->threads)
+		goto done;
+
+	uint32_t used = atomic_load(&h->threads_used);
+	if (used > h->threads)
+		used = h->threads;
+
+	slots = (const lwlog_flight_slot **)malloc(((size_t)used * h->slots + 1) * sizeof(*slots));
+	if (slots == NULL)
+		goto done;
+
+	size_t n = 0;
+	for (uint32_t t = 0; t < used; t++)
+	{
+		lwlog_flight_ring *ring = lwlog_flight_ring_at(map, h, t);
+		for (uint32_t i = 0; i < h->slots; i++)
+		{
+			const lwlog_flight_slot *slot = lwlog_flight_slot_at(ring, i);
+			if (atomic_load((_Atomic uint32_t *)&slot->seq) != 0 && slot->len < LW_MSG_MAXLEN)
+				slots[n++] = slot;
+		}
+	}
+	qsort(slots, n, sizeof(*slots), lwlog_flight_compare);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const lwlog_flight_slot *slot = slots[i];
+		char text[LW_MSG_MAXLEN + 1];
+
+		if (slot->kind == LWLOG_RECORD)
+		{
+			/* Look the site up in the file, not in this process */
+			lwlog_site_t site, *psite = NULL;
+			uint32_t id = 0;
+			if (slot->len >= LWLOG_RECORD_HEADER)
+				memcpy(&id, slot->data + 8, 4);
+			if (id != 0 && id < LWLOG_FLIGHT_SITES)
+			{
+				const char *entry = lwlog_flight_site_at(map, id);
+				lwlog_flight_site_entry e;
+				memcpy(&e, entry, sizeof(e));
+				if (e.id == id && (size_t)e.file_len + e.func_len + e.fmt_len + 3 <=
+						      LWLOG_FLIGHT_SITE_SIZE - LWLOG_FLIGHT_SITE_FIXED)
+				{
+					site.file = entry + LWLOG_FLIGHT_SITE_FIXED;
+					site.func = site.file + e.file_len + 1;
+					site.fmt = site.func + e.func_len + 1;
+					site.line = e.line;
+					site.level = e.level;
+					site.category = 0;
+					psite = &site;
+				}
+			}
+			lwlog_render_site(psite, slot->data, slot->len, 0, text, sizeof(text));
+		}
+		else
+		{
+			memcpy(text, slot->data, slot->len);
+			text[slot->len] = '\0';
+		}
+
+		fprintf(out,
+			"%llu.%09llu [%u] %s\n",
+			(unsigned long long)(slot->ts / 1000000000u),
+			(unsigned long long)(slot->ts % 1000000000u),
+			slot->tid,
+			text);
+	}
+	rc = ferror(out) ? -1 : 0;
+
+done:
+	free(slots);
+	munmap(map, size);
+	return rc;
+}
+
+int
+lwlog_async_start(size_t capacity, lwlog_overflow_t policy, int fd)
+{
+	lwlog_ring *r = &lwlog_async;
+	int rc = -1;
+
+	pthread_mutex_lock(&lwlog_control);
+	if (atomic_load(&lwlog_active) != NULL)
+		goto done;
+
+	if (r->slots == NULL)
+	{
+		size_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		r->slots = (lwlog_slot *)malloc(n * sizeof(lwlog_slot));
+		if (r->slots == NULL)
+			goto done;
+		r->mask = n - 1;
+		for (size_t i = 0; i < n; i++)
+			atomic_init(&r->slots[i].seq, i);
+		atomic_init(&r->head, 0);
+		atomic_init(&r->written, 0);
+		r->tail = 0;
+		pthread_mutex_init(&r->lock, NULL);
+		pthread_cond_init(&r->wake, NULL);
+		pthread_cond_init(&r->flushed, NULL);
+		atexit(lwlog_async_stop);
+	}
+
+	/* Leftovers of writers that raced with the last stop */
+	fflush(stderr);
+	lwlog_drain(r);
+
+	r->policy = policy;
+	r->fd = fd;
+	r->stopping = false;
+	if (pthread_create(&r->thread, NULL, lwlog_consumer, r) != 0)
+		goto done;
+
+	atomic_store_explicit(&lwlog_active, r, memory_order_release);
+	rc = 0;
+
+done:
+	pthread_mutex_unlock(&lwlog_control);
+	return rc;
+}
+
+void
+lwlog_async_stop(void)
+{
+	lwlog_ring *r = &lwlog_async;
+
+	pthread_mutex_lock(&lwlog_control);
+	if (atomic_load(&lwlog_active) == NULL)
+	{
+		pthread_mutex_unlock(&lwlog_control);
+		return;
+	}
+	atomic_store_explicit(&lwlog_active, NULL, memory_order_release);
+
+	pthread_mutex_lock(&r->lock);
+	r->stopping = true;
+	pthread_cond_signal(&r->wake);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->thread, NULL);
+
+	/* Release flushers still waiting for a slot that was never published */
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_broadcast(&r->flushed);
+	pthread_mutex_unlock(&r->lock);
+
+	pthread_mutex_unlock(&lwlog_control);
+}
+
+void
+lwlog_flush(void)
+{
+	lwlog_ring *r = atomic_load_explicit(&lwlog_active, memory_order_acquire);
+	if (r == NULL)
+	{
+		fflush(stderr);
+		return;
+	}
+
+	size_t target = atomic_load(&r->head);
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_signal(&r->wake);
+	while (atomic_load_explicit(&r->written, memory_order_acquire) < target &&
+	       atomic_load(&lwlog_active) == r)
+		pthread_cond_wait(&r->flushed, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+}
+
+uint64_t
+lwlog_dropped(void)
+{
+	return atomic_load_explicit(&lwlog_async.dropped, memory_order_relaxed);
+}
+
 void
 lwnotice(const char *fmt, ...)
 {
@@ -66,6 +1232,28 @@ lwdebug(int level, const char *fmt, ...)
 {
 	va_list ap;
 
+	/*
+	 * Only the runtime level: LWLOG_COMPILE_LEVEL strips macro call sites
+	 * in the caller's translation unit, not direct calls to this function.
+	 */
+	if (level > atomic_load_explicit(&lwlog_levels[LWLOG_CAT_DEFAULT],
+					 memory_order_relaxed))
+		return;
+
+	va_start(ap, fmt);
+
+	/* Call the supplied function */
+	(*lwdebug_var)(level, fmt, ap);
+
+	va_end(ap);
+}
+
+void
+lwdebugc(lwlog_category_t cat, int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	(void)cat; /* already checked by the macro */
 	va_start(ap, fmt);
 
 	/* Call the supplied function */
@@ -77,48 +1265,120 @@ lwdebug(int level, const char *fmt, ...)
 void
 lwsetloglevel(log_level_t level)
 {
-	default_loglevel = level;
+	for (int i = 0; i < LWLOG_CAT_COUNT; i++)
+		atomic_store_explicit(&lwlog_levels[i], (int)level, memory_order_relaxed);
 }
 
 log_level_t
 lwgetloglevel(void)
 {
-	return default_loglevel;
+	return (log_level_t)lwlog_get_category_level(LWLOG_CAT_DEFAULT);
+}
+
+void
+lwlog_set_category_level(lwlog_category_t cat, int level)
+{
+	if ((unsigned)cat < LWLOG_CAT_COUNT)
+		atomic_store_explicit(&lwlog_levels[cat], level, memory_order_relaxed);
+}
+
+int
+lwlog_get_category_level(lwlog_category_t cat)
+{
+	if ((unsigned)cat >= LWLOG_CAT_COUNT)
+		return 0;
+	return atomic_load_explicit(&lwlog_levels[cat], memory_order_relaxed);
+}
+
+const char *
+lwlog_category_name(lwlog_category_t cat)
+{
+	return (unsigned)cat < LWLOG_CAT_COUNT ? lwlog_category_names[cat] : NULL;
+}
+
+int
+lwlog_configure(const char *spec)
+{
+	int rc = 0;
+
+	while (*spec)
+	{
+		const char *end = strchr(spec, ',');
+		size_t len = end ? (size_t)(end - spec) : strlen(spec);
+		const char *eq = memchr(spec, '=', len);
+		char *num_end;
+
+		if (eq == NULL)
+		{
+			long level = strtol(spec, &num_end, 10);
+			if (num_end == spec + len && len > 0)
+				lwsetloglevel((log_level_t)level);
+			else
+				rc = -1;
+		}
+		else
+		{
+			size_t name_len = (size_t)(eq - spec);
+			long level = strtol(eq + 1, &num_end, 10);
+			int cat;
+
+			for (cat = 0; cat < LWLOG_CAT_COUNT; cat++)
+			{
+				if (strlen(lwlog_category_names[cat]) == name_len &&
+				    strncmp(lwlog_category_names[cat], spec, name_len) == 0)
+					break;
+			}
+			if (cat < LWLOG_CAT_COUNT && num_end == spec + len && num_end > eq + 1)
+				lwlog_set_category_level((lwlog_category_t)cat, (int)level);
+			else
+				rc = -1;
+		}
+
+		spec += len;
+		if (*spec == ',')
+			spec++;
+	}
+	return rc;
 }
 
 static void
 default_noticereporter(const char *fmt, va_list ap)
 {
-	char msg[LW_MSG_MAXLEN + 1];
-	vsnprintf(msg, LW_MSG_MAXLEN, fmt, ap);
-	msg[LW_MSG_MAXLEN] = '\0';
-	fprintf(stderr, "%s\n", msg);
+	va_list copy;
+	va_copy(copy, ap);
+	lwlog_flight_text(0, fmt, copy);
+	va_end(copy);
+
+	lwlog_emit(0, fmt, ap);
 }
 
 static void
 default_debuglogger(int level, const char *fmt, va_list ap)
 {
-	char msg[LW_MSG_MAXLEN + 1];
-	if (default_loglevel >= level)
-	{
-		/* Space pad the debug output */
-		int i;
-		for (i = 0; i < level; i++)
-			msg[i] = ' ';
-		vsnprintf(msg + i, LW_MSG_MAXLEN - i, fmt, ap);
-		msg[LW_MSG_MAXLEN] = '\0';
-		fprintf(stderr, "%s\n", msg);
-	}
+	/* Debug output goes only to the flight recorder while it runs */
+	va_list copy;
+	va_copy(copy, ap);
+	bool recorded = lwlog_flight_text(level, fmt, copy);
+	va_end(copy);
+	if (recorded)
+		return;
+
+	/* The level was checked at the call site; space pad the output */
+	lwlog_emit(level, fmt, ap);
 }
 
 static void
 default_errorreporter(const char *fmt, va_list ap)
 {
-	char msg[LW_MSG_MAXLEN + 1];
-	vsnprintf(msg, LW_MSG_MAXLEN, fmt, ap);
-	msg[LW_MSG_MAXLEN] = '\0';
-	fprintf(stderr, "%s\n", msg);
+	va_list copy;
+	va_copy(copy, ap);
+	lwlog_flight_text(0, fmt, copy);
+	va_end(copy);
+
+	lwlog_emit(0, fmt, ap);
+	/* Nothing queued may be lost on the way out */
+	lwlog_async_stop();
 	exit(1);
 }
 
-#undef LW_MSG_MAXLEN
\ No newline at end of file
+#undef LW_MSG_MAXLEN
@@ -24,6 +24,10 @@
 #define __NOSHIRO_LOG_H__
 
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 typedef enum
 {
@@ -37,31 +41,237 @@ typedef enum
 typedef void (*lwreporter)(const char *fmt, va_list ap);
 typedef void (*lwdebuglogger)(int level, const char *fmt, va_list ap);
 
-/* Display a notice at the given debug level */
-#define LWDEBUG(level, msg) \
+/*
+ * Log categories, one per subsystem. Each has its own debug level that can
+ * be changed at runtime; a debug message is emitted when its level is at
+ * most the level of its category.
+ */
+typedef enum
+{
+	LWLOG_CAT_DEFAULT,
+	LWLOG_CAT_SDS,
+	LWLOG_CAT_SDA,
+	LWLOG_CAT_BITSET,
+	LWLOG_CAT_HASH,
+	LWLOG_CAT_UUID,
+	LWLOG_CAT_IO,
+	LWLOG_CAT_COUNT
+} lwlog_category_t;
+
+/* Current level of every category; read through lwlog_enabled() */
+extern _Atomic int lwlog_levels[LWLOG_CAT_COUNT];
+
+#ifndef POSTGIS_DEBUG_LEVEL
+#define POSTGIS_DEBUG_LEVEL 0
+#endif
+
+/* Debug levels above this are compiled out of the macros entirely */
+#ifndef LWLOG_COMPILE_LEVEL
+#define LWLOG_COMPILE_LEVEL POSTGIS_DEBUG_LEVEL
+#endif
+
+/* The compile-time test folds away; the runtime one is a single load */
+#define lwlog_enabled(cat, level) \
+	((level) <= LWLOG_COMPILE_LEVEL && \
+	 (level) <= atomic_load_explicit(&lwlog_levels[(cat)], memory_order_relaxed))
+
+/* Display a notice at the given debug level of a category */
+#define LWDEBUGC(cat, level, msg) \
+	do \
+	{ \
+		if (lwlog_enabled(cat, level)) \
+			lwdebugc(cat, \
+				 level, \
+				 "[%s:%s:%d] " msg, \
+				 __FILE__, \
+				 __func__, \
+				 __LINE__); \
+	} while (0)
+
+/* Display a formatted notice at the given debug level of a category
+ * (like printf, with variadic arguments) */
+#define LWDEBUGCF(cat, level, msg, ...) \
 	do \
 	{ \
-		if (POSTGIS_DEBUG_LEVEL >= level) \
-			lwdebug(level, \
-				"[%s:%s:%d] " msg, \
-				__FILE__, \
-				__func__, \
-				__LINE__); \
-	} while (0);
+		if (lwlog_enabled(cat, level)) \
+			lwdebugc(cat, \
+				 level, \
+				 "[%s:%s:%d] " msg, \
+				 __FILE__, \
+				 __func__, \
+				 __LINE__, \
+				 __VA_ARGS__); \
+	} while (0)
+
+/* Display a notice at the given debug level */
+#define LWDEBUG(level, msg) LWDEBUGC(LWLOG_CAT_DEFAULT, level, msg)
 
 /* Display a formatted notice at the given debug level
  * (like printf, with variadic arguments) */
-#define LWDEBUGF(level, msg, ...) \
+#define LWDEBUGF(level, msg, ...) LWDEBUGCF(LWLOG_CAT_DEFAULT, level, msg, __VA_ARGS__)
+
+/*
+ * Binary debug records with deferred formatting.
+ *
+ * LWDEBUGB() takes the same arguments as LWDEBUGF(), but the calling thread
+ * only copies the raw argument values, tagged with their type, next to the
+ * id of a static per-call-site descriptor and a timestamp. The text is
+ * produced later by the async sink's background thread (or right away when
+ * the sink is not running), or offline with lwlog_record_format().
+ *
+ * Supported arguments are integers, floating point values, strings (their
+ * bytes are copied) and pointers, at most LWLOG_MAX_ARGS of them. Width and
+ * precision given as '*' are not supported.
+ */
+#define LWLOG_MAX_ARGS 10
+
+typedef enum
+{
+	LWLOG_ARG_INT,
+	LWLOG_ARG_UINT,
+	LWLOG_ARG_DOUBLE,
+	LWLOG_ARG_STR,
+	LWLOG_ARG_PTR
+} lwlog_arg_type_t;
+
+typedef struct {
+	uint8_t type; ///< lwlog_arg_type_t
+	union {
+		int64_t i;
+		uint64_t u;
+		double d;
+		const char *s;
+		const void *p;
+	} v;
+} lwlog_arg_t;
+
+/* One per LWDEBUGB() call site; id is assigned on first use */
+typedef struct {
+	const char *fmt;
+	const char *file;
+	const char *func;
+	int line;
+	int level;
+	int category;
+	_Atomic uint32_t id;
+} lwlog_site_t;
+
+static inline lwlog_arg_t
+lwlog_arg_int(int64_t v)
+{
+	lwlog_arg_t a = {.type = LWLOG_ARG_INT, .v.i = v};
+	return a;
+}
+
+static inline lwlog_arg_t
+lwlog_arg_uint(uint64_t v)
+{
+	lwlog_arg_t a = {.type = LWLOG_ARG_UINT, .v.u = v};
+	return a;
+}
+
+static inline lwlog_arg_t
+lwlog_arg_double(double v)
+{
+	lwlog_arg_t a = {.type = LWLOG_ARG_DOUBLE, .v.d = v};
+	return a;
+}
+
+static inline lwlog_arg_t
+lwlog_arg_str(const char *v)
+{
+	lwlog_arg_t a = {.type = LWLOG_ARG_STR, .v.s = v};
+	return a;
+}
+
+static inline lwlog_arg_t
+lwlog_arg_ptr(const void *v)
+{
+	lwlog_arg_t a = {.type = LWLOG_ARG_PTR, .v.p = v};
+	return a;
+}
+
+/* Tag an argument by its static type */
+#define LWLOG_ARG(x) \
+	_Generic((x), \
+		_Bool: lwlog_arg_int, \
+		char: lwlog_arg_int, \
+		signed char: lwlog_arg_int, \
+		short: lwlog_arg_int, \
+		int: lwlog_arg_int, \
+		long: lwlog_arg_int, \
+		long long: lwlog_arg_int, \
+		unsigned char: lwlog_arg_uint, \
+		unsigned short: lwlog_arg_uint, \
+		unsigned int: lwlog_arg_uint, \
+		unsigned long: lwlog_arg_uint, \
+		unsigned long long: lwlog_arg_uint, \
+		float: lwlog_arg_double, \
+		double: lwlog_arg_double, \
+		long double: lwlog_arg_double, \
+		char *: lwlog_arg_str, \
+		const char *: lwlog_arg_str, \
+		default: lwlog_arg_ptr)(x)
+
+#define LWLOG_CAT_(a, b) a##b
+#define LWLOG_CAT(a, b) LWLOG_CAT_(a, b)
+#define LWLOG_NARG_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, n, ...) n
+#define LWLOG_NARG(...) LWLOG_NARG_(__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LWLOG_MAP_1(f, x) f(x)
+#define LWLOG_MAP_2(f, x, ...) f(x), LWLOG_MAP_1(f, __VA_ARGS__)
+#define LWLOG_MAP_3(f, x, ...) f(x), LWLOG_MAP_2(f, __VA_ARGS__)
+#define LWLOG_MAP_4(f, x, ...) f(x), LWLOG_MAP_3(f, __VA_ARGS__)
+#define LWLOG_MAP_5(f, x, ...) f(x), LWLOG_MAP_4(f, __VA_ARGS__)
+#define LWLOG_MAP_6(f, x, ...) f(x), LWLOG_MAP_5(f, __VA_ARGS__)
+#define LWLOG_MAP_7(f, x, ...) f(x), LWLOG_MAP_6(f, __VA_ARGS__)
+#define LWLOG_MAP_8(f, x, ...) f(x), LWLOG_MAP_7(f, __VA_ARGS__)
+#define LWLOG_MAP_9(f, x, ...) f(x), LWLOG_MAP_8(f, __VA_ARGS__)
+#define LWLOG_MAP_10(f, x, ...) f(x), LWLOG_MAP_9(f, __VA_ARGS__)
+#define LWLOG_MAP(f, ...) LWLOG_CAT(LWLOG_MAP_, LWLOG_NARG(__VA_ARGS__))(f, __VA_ARGS__)
+
+/* Log a binary record at the given debug level of a category
+ * (like LWDEBUGCF, formatted later) */
+#define LWDEBUGCB(cat, level, msg, ...) \
 	do \
 	{ \
-		if (POSTGIS_DEBUG_LEVEL >= level) \
-			lwdebug(level, \
-				"[%s:%s:%d] " msg, \
-				__FILE__, \
-				__func__, \
-				__LINE__, \
-				__VA_ARGS__); \
-	} while (0);
+		if (lwlog_enabled(cat, level)) \
+		{ \
+			static lwlog_site_t lwlog_site_ = { \
+			    msg, __FILE__, __func__, __LINE__, level, cat, 0}; \
+			const lwlog_arg_t lwlog_args_[] = { \
+			    LWLOG_MAP(LWLOG_ARG, __VA_ARGS__)}; \
+			lwlog_binary(&lwlog_site_, \
+				     lwlog_args_, \
+				     sizeof(lwlog_args_) / sizeof(lwlog_args_[0])); \
+		} \
+	} while (0)
+
+#define LWDEBUGB(level, msg, ...) LWDEBUGCB(LWLOG_CAT_DEFAULT, level, msg, __VA_ARGS__)
+
+/**
+ * Record a binary debug message. Don't call this function directly, use
+ * the LWDEBUGB() macro.
+ * @ingroup logging
+ */
+void lwlog_binary(lwlog_site_t *site, const lwlog_arg_t *args, size_t nargs);
+
+/**
+ * Look up a call site by the id stored in its records.
+ *
+ * @return the site, or NULL if no site has that id
+ * @ingroup logging
+ */
+const lwlog_site_t *lwlog_site_get(uint32_t id);
+
+/**
+ * Render an encoded binary record as the text LWDEBUGF() would have
+ * printed, using the site table of this process.
+ *
+ * @return the length of the text, which is truncated to @p cap - 1 bytes
+ *         and NUL terminated
+ * @ingroup logging
+ */
+size_t lwlog_record_format(const void *rec, size_t len, char *out, size_t cap);
 
 /**
  * Write a notice out to the notice handler.
@@ -92,8 +302,110 @@ void lwerror(const char *fmt, ...);
  */
 void lwdebug(int level, const char *fmt, ...);
 
+/**
+ * Write a debug message of a category out, without checking its level.
+ * Don't call this function directly, use the macros,
+ * LWDEBUGC() or LWDEBUGCF(), which check it first.
+ * @ingroup logging
+ */
+void lwdebugc(lwlog_category_t cat, int level, const char *fmt, ...);
+
+/* Set the level of every category */
 void lwsetloglevel(log_level_t level);
 
+/* The level of the default category */
 log_level_t lwgetloglevel(void);
 
+void lwlog_set_category_level(lwlog_category_t cat, int level);
+int lwlog_get_category_level(lwlog_category_t cat);
+const char *lwlog_category_name(lwlog_category_t cat);
+
+/**
+ * Set levels from a string such as "3" (every category) or
+ * "sds=4,io=1". Category names are those of lwlog_category_name().
+ *
+ * @return 0 on success, -1 if part of the string was not understood
+ *         (the valid parts are still applied)
+ * @ingroup logging
+ */
+int lwlog_configure(const char *spec);
+
+/* What a logging thread does when the async ring is full */
+typedef enum
+{
+	LWLOG_DROP, ///< discard the message and count it
+	LWLOG_BLOCK ///< wait for the background thread to make room
+} lwlog_overflow_t;
+
+/**
+ * Route the default notice, debug and error reporters through an
+ * asynchronous sink.
+ *
+ * Messages are formatted into a lock-free multi-producer ring and a
+ * background thread writes them to @p fd in large batches, so the calling
+ * thread never waits on the output. lwerror() flushes the ring before it
+ * exits the process.
+ *
+ * @param capacity number of queued messages, rounded up to a power of two;
+ *                 only used the first time, the ring is kept afterwards so
+ *                 late writers never touch freed memory
+ * @param policy   behaviour when the ring is full
+ * @param fd       output file descriptor, e.g. STDERR_FILENO
+ * @return 0 on success, -1 on failure or if the sink is already running
+ * @ingroup logging
+ */
+int lwlog_async_start(size_t capacity, lwlog_overflow_t policy, int fd);
+
+/**
+ * Write out everything queued so far and stop the background thread.
+ * Logging is synchronous again afterwards.
+ * @ingroup logging
+ */
+void lwlog_async_stop(void);
+
+/**
+ * Wait until every message logged before the call has been written.
+ * @ingroup logging
+ */
+void lwlog_flush(void);
+
+/**
+ * Start the flight recorder.
+ *
+ * While it runs, debug messages (LWDEBUG*) are no longer written out but
+ * kept in a fixed-size ring per thread inside a memory-mapped file, so the
+ * most recent history survives a crash of the process. Notices and errors
+ * are recorded as well as written out. Binary records are stored as is.
+ * The mapping stays in place until the process exits.
+ *
+ * @param path    file to create or truncate
+ * @param threads number of rings; threads beyond it record nothing
+ * @param records number of records kept per thread
+ * @return 0 on success, -1 on failure or if it was started before
+ * @ingroup logging
+ */
+int lwlog_flight_start(const char *path, size_t threads, size_t records);
+
+/**
+ * Stop recording and write the file back to disk.
+ * @ingroup logging
+ */
+void lwlog_flight_stop(void);
+
+/**
+ * Print the records of a flight recorder file, oldest first, one per line
+ * as "seconds.nanoseconds [thread id] text". Call sites are taken from the
+ * file, so this works in another process (on the same architecture).
+ *
+ * @return 0 on success, -1 if the file cannot be read or is not valid
+ * @ingroup logging
+ */
+int lwlog_flight_decode(const char *path, FILE *out);
+
+/**
+ * Number of messages discarded by the LWLOG_DROP policy.
+ * @ingroup logging
+ */
+uint64_t lwlog_dropped(void);
+
 #endif /* __NOSHIRO_LOG_H__ */
\ No newline at end of file
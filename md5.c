@@ -21,8 +21,19 @@
  */
 
 #include "md5.h"
+#include "cpu.h"
+#include "stats.h"
+#include "trace.h"
 
-const int av_md5_size = sizeof(md5_t);
+#include <string.h>
+
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+const int md5_size = sizeof(md5_t);
+
+static void md5_transform(uint32_t buf[4], uint32_t const in[16]);
 
 static void
 byteSwap(uint32_t *buf, unsigned words)
@@ -45,7 +56,7 @@ byteSwap(uint32_t *buf, unsigned words)
  * Start MD5 accumulation.  Set bit count to 0 and buffer to mysterious
  * initialization constants.
  */
-static void
+void
 md5_init(md5_t *ctx)
 {
 	ctx->buf[0] = 0x67452301;
@@ -61,7 +72,7 @@ md5_init(md5_t *ctx)
  * Update context to reflect the concatenation of another buffer full
  * of bytes.
  */
-static void
+void
 md5_update(md5_t *ctx, const uint8_t *src, size_t len)
 {
 	uint32_t t;
@@ -81,7 +92,7 @@ md5_update(md5_t *ctx, const uint8_t *src, size_t len)
 	/* First chunk is an odd size */
 	memcpy((uint8_t *)ctx->in + 64 - t, src, t);
 	byteSwap(ctx->in, 16);
-	MD5Transform(ctx->buf, ctx->in);
+	md5_transform(ctx->buf, ctx->in);
 	src += t;
 	len -= t;
 
@@ -90,7 +101,7 @@ md5_update(md5_t *ctx, const uint8_t *src, size_t len)
 	{
 		memcpy(ctx->in, src, 64);
 		byteSwap(ctx->in, 16);
-		MD5Transform(ctx->buf, ctx->in);
+		md5_transform(ctx->buf, ctx->in);
 		src += 64;
 		len -= 64;
 	}
@@ -103,7 +114,7 @@ md5_update(md5_t *ctx, const uint8_t *src, size_t len)
  * Final wrapup - pad to 64-byte boundary with the bit pattern
  * 1 0* (64-bit count of bits processed, MSB-first)
  */
-static void
+void
 md5_final(md5_t *ctx, uint8_t *dst)
 {
 	int count = ctx->bytes[0] & 0x3f; /* Number of bytes in ctx->in */
@@ -119,7 +130,7 @@ md5_final(md5_t *ctx, uint8_t *dst)
 	{ /* Padding forces an extra block */
 		memset(p, 0, count + 8);
 		byteSwap(ctx->in, 16);
-		MD5Transform(ctx->buf, ctx->in);
+		md5_transform(ctx->buf, ctx->in);
 		p = (uint8_t *)ctx->in;
 		count = 56;
 	}
@@ -129,7 +140,7 @@ md5_final(md5_t *ctx, uint8_t *dst)
 	/* Append length in bits and transform */
 	ctx->in[14] = ctx->bytes[0] << 3;
 	ctx->in[15] = ctx->bytes[1] << 3 | ctx->bytes[0] >> 29;
-	MD5Transform(ctx->buf, ctx->in);
+	md5_transform(ctx->buf, ctx->in);
 
 	byteSwap(ctx->buf, 4);
 	memcpy(dst, ctx->buf, 16);
@@ -246,7 +257,273 @@ md5_sum(uint8_t *dst, const uint8_t *src, size_t len)
 {
 	md5_t ctx;
 
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_HASHES);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, len);
+
 	md5_init(&ctx);
 	md5_update(&ctx, src, len);
 	md5_final(&ctx, dst);
+}
+
+/* ---------------------------- multi-buffer ---------------------------- */
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+#define MD5_MB_MAX_LANES 16
+
+/* Per step: message word, additive constant and rotation */
+static const uint8_t md5_mb_index[64] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+    5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+    0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9,
+};
+
+static const uint32_t md5_mb_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t md5_mb_shift[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+/*
+ * One MD5 block for every lane. Lane l of the state is state[r * L + l]
+ * for r = a, b, c, d and its message word j is w[j * L + l], L being the
+ * number of 32-bit lanes of V. The loop is fully unrolled so the tables
+ * fold into immediates.
+ */
+#define MD5_MB_KERNEL(name, isa, V, LOAD, STORE, ADD, AND, OR, XOR, SET1, ROTL) \
+	NOSHIRO_TARGET(isa) \
+	static void name(uint32_t *state, const uint32_t *w) \
+	{ \
+		const size_t L = sizeof(V) / 4; \
+		V a = LOAD(state), b = LOAD(state + L), c = LOAD(state + 2 * L), \
+		  d = LOAD(state + 3 * L); \
+		V a0 = a, b0 = b, c0 = c, d0 = d, ones = SET1(-1); \
+		_Pragma("GCC unroll 64") for (int i = 0; i < 64; i++) \
+		{ \
+			V f, t; \
+			if (i < 16) \
+				f = XOR(d, AND(b, XOR(c, d))); \
+			else if (i < 32) \
+				f = XOR(c, AND(d, XOR(b, c))); \
+			else if (i < 48) \
+				f = XOR(XOR(b, c), d); \
+			else \
+				f = XOR(c, OR(b, XOR(d, ones))); \
+			t = ADD(ADD(a, f), ADD(LOAD(w + md5_mb_index[i] * L), \
+					       SET1((int)md5_mb_k[i]))); \
+			a = d; \
+			d = c; \
+			c = b; \
+			b = ADD(b, ROTL(t, md5_mb_shift[i])); \
+		} \
+		STORE(state, ADD(a, a0)); \
+		STORE(state + L, ADD(b, b0)); \
+		STORE(state + 2 * L, ADD(c, c0)); \
+		STORE(state + 3 * L, ADD(d, d0)); \
+	}
+
+#define MD5_LOAD128(p)     _mm_loadu_si128((const __m128i *)(const void *)(p))
+#define MD5_STORE128(p, v) _mm_storeu_si128((__m128i *)(void *)(p), (v))
+#define MD5_ROTL128(x, s) \
+	_mm_or_si128(_mm_slli_epi32((x), (s)), _mm_srli_epi32((x), 32 - (s)))
+MD5_MB_KERNEL(md5_mb_sse2, "sse2", __m128i, MD5_LOAD128, MD5_STORE128,
+	      _mm_add_epi32, _mm_and_si128, _mm_or_si128, _mm_xor_si128,
+	      _mm_set1_epi32, MD5_ROTL128)
+
+#define MD5_LOAD256(p)     _mm256_loadu_si256((const __m256i *)(const void *)(p))
+#define MD5_STORE256(p, v) _mm256_storeu_si256((__m256i *)(void *)(p), (v))
+#define MD5_ROTL256(x, s) \
+	_mm256_or_si256(_mm256_slli_epi32((x), (s)), _mm256_srli_epi32((x), 32 - (s)))
+MD5_MB_KERNEL(md5_mb_avx2, "avx2", __m256i, MD5_LOAD256, MD5_STORE256,
+	      _mm256_add_epi32, _mm256_and_si256, _mm256_or_si256,
+	      _mm256_xor_si256, _mm256_set1_epi32, MD5_ROTL256)
+
+#define MD5_LOAD512(p)     _mm512_loadu_si512((const void *)(p))
+#define MD5_STORE512(p, v) _mm512_storeu_si512((void *)(p), (v))
+#define MD5_ROTL512(x, s)  _mm512_rolv_epi32((x), _mm512_set1_epi32(s))
+MD5_MB_KERNEL(md5_mb_avx512, "avx512f", __m512i, MD5_LOAD512, MD5_STORE512,
+	      _mm512_add_epi32, _mm512_and_si512, _mm512_or_si512,
+	      _mm512_xor_si512, _mm512_set1_epi32, MD5_ROTL512)
+
+typedef void (*md5_mb_fn)(uint32_t *state, const uint32_t *w);
+
+typedef struct {
+	const uint8_t *src; /* message */
+	size_t msg;         /* its index */
+	size_t block;       /* next block */
+	size_t full;        /* blocks read straight from src */
+	size_t nblocks;     /* full + 1 or 2 padding blocks, 0 when idle */
+	uint8_t tail[128];
+} md5_mb_lane;
+
+static void
+md5_mb_assign(md5_mb_lane *lane, uint32_t *state, size_t lanes, size_t l,
+	      const uint8_t *src, size_t len, size_t msg)
+{
+	size_t rest = len & 63;
+	uint64_t bits = (uint64_t)len << 3;
+
+	lane->src = src;
+	lane->msg = msg;
+	lane->block = 0;
+	lane->full = len / 64;
+	lane->nblocks = lane->full + (rest < 56 ? 1 : 2);
+
+	/* The remaining bytes, 0x80, zeros and the little-endian bit count */
+	memset(lane->tail, 0, sizeof(lane->tail));
+	if (rest)
+		memcpy(lane->tail, src + lane->full * 64, rest);
+	lane->tail[rest] = 0x80;
+	memcpy(lane->tail + (lane->nblocks - lane->full) * 64 - 8, &bits, 8);
+
+	state[l] = 0x67452301;
+	state[lanes + l] = 0xefcdab89;
+	state[2 * lanes + l] = 0x98badcfe;
+	state[3 * lanes + l] = 0x10325476;
+}
+
+/*
+ * Transposes the 64-byte blocks of four lanes into w, four words of each
+ * at a time.
+ */
+NOSHIRO_TARGET("sse2")
+static void
+md5_mb_transpose4(uint32_t *w, size_t lanes, const uint8_t *const p[4])
+{
+	for (size_t k = 0; k < 4; k++)
+	{
+		__m128i r0 = MD5_LOAD128(p[0] + k * 16);
+		__m128i r1 = MD5_LOAD128(p[1] + k * 16);
+		__m128i r2 = MD5_LOAD128(p[2] + k * 16);
+		__m128i r3 = MD5_LOAD128(p[3] + k * 16);
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+		__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+		uint32_t *row = w + k * 4 * lanes;
+
+		MD5_STORE128(row, _mm_unpacklo_epi64(t0, t1));
+		MD5_STORE128(row + lanes, _mm_unpackhi_epi64(t0, t1));
+		MD5_STORE128(row + 2 * lanes, _mm_unpacklo_epi64(t2, t3));
+		MD5_STORE128(row + 3 * lanes, _mm_unpackhi_epi64(t2, t3));
+	}
+}
+
+static void
+md5_mb_run(md5_mb_fn fn, size_t lanes, uint8_t *dst,
+	   const uint8_t *const *src, const size_t *lens, size_t n)
+{
+	static const uint8_t idle_block[64];
+	md5_mb_lane lane[MD5_MB_MAX_LANES];
+	uint32_t state[4 * MD5_MB_MAX_LANES];
+	uint32_t w[16 * MD5_MB_MAX_LANES];
+	const uint8_t *p[MD5_MB_MAX_LANES];
+	size_t next = 0, active = 0;
+
+	for (size_t l = 0; l < lanes; l++)
+	{
+		lane[l].nblocks = 0;
+		if (next < n)
+		{
+			md5_mb_assign(&lane[l], state, lanes, l, src[next], lens[next],
+				      next);
+			next++;
+			active++;
+		}
+	}
+
+	while (active)
+	{
+		for (size_t l = 0; l < lanes; l++)
+		{
+			const md5_mb_lane *ln = &lane[l];
+
+			if (!ln->nblocks)
+				p[l] = idle_block;
+			else if (ln->block < ln->full)
+				p[l] = ln->src + ln->block * 64;
+			else
+				p[l] = ln->tail + (ln->block - ln->full) * 64;
+		}
+		for (size_t l = 0; l < lanes; l += 4)
+			md5_mb_transpose4(w + l, lanes, p + l);
+
+		fn(state, w);
+
+		for (size_t l = 0; l < lanes; l++)
+		{
+			md5_mb_lane *ln = &lane[l];
+
+			if (!ln->nblocks || ++ln->block < ln->nblocks)
+				continue;
+
+			for (size_t r = 0; r < 4; r++)
+				memcpy(dst + ln->msg * 16 + r * 4, &state[r * lanes + l], 4);
+
+			if (next < n)
+			{
+				md5_mb_assign(ln, state, lanes, l, src[next], lens[next],
+					      next);
+				next++;
+			}
+			else
+			{
+				ln->nblocks = 0;
+				active--;
+			}
+		}
+	}
+}
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+void
+md5_sum_many(uint8_t *dst, const uint8_t *const *src, const size_t *lens,
+	     size_t n)
+{
+	TRACE_BEGIN_N(span, "md5_sum_many", n);
+
+#ifdef NOSHIRO_X86_DISPATCH
+	md5_mb_fn fn = NULL;
+	size_t lanes = 0;
+
+	if (cpu_supports("avx512f"))
+		fn = md5_mb_avx512, lanes = 16;
+	else if (cpu_supports("avx2"))
+		fn = md5_mb_avx2, lanes = 8;
+	else if (cpu_supports("sse2"))
+		fn = md5_mb_sse2, lanes = 4;
+
+	/* The SIMD kernels write little-endian words straight to dst */
+	if (fn && n > 1)
+	{
+		md5_mb_run(fn, lanes, dst, src, lens, n);
+
+		for (size_t i = 0; i < n; i++)
+			NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, lens[i]);
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASHES, n);
+		TRACE_END(span);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < n; i++)
+		md5_sum(dst + i * 16, src[i], lens[i]);
+
+	TRACE_END(span);
 }
\ No newline at end of file
@@ -67,4 +67,18 @@ void md5_final(md5_t *ctx, uint8_t *dst);
  */
 void md5_sum(uint8_t *dst, const uint8_t *src, size_t len);
 
+/**
+ * Hash n independent messages, several at a time in SIMD lanes (4 with
+ * SSE2, 8 with AVX2, 16 with AVX-512) when the CPU supports it. Lanes
+ * that finish a message pick up the next one, so messages of different
+ * lengths keep all lanes busy. The digests are identical to md5_sum().
+ *
+ * @param dst  The output buffer of 16 * n bytes, digest i at dst + 16 * i
+ * @param src  Array of n pointers to the messages
+ * @param lens Array of the n message lengths, in bytes
+ * @param n    Number of messages
+ */
+void md5_sum_many(uint8_t *dst, const uint8_t *const *src, const size_t *lens,
+		  size_t n);
+
 #endif /* __NOSHIRO_MD5_H__ */
\ No newline at end of file
@@ -0,0 +1,1419 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "roaring.h"
+#include "cpu.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ROARING_ARRAY_MAX    4096 /* larger arrays become bitmaps */
+#define ROARING_BITMAP_WORDS 1024 /* 65536 bits */
+#define ROARING_MAGIC        "NSHROAR1"
+#define ROARING_HEADER_SIZE  16
+#define ROARING_DESC_SIZE    24
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ROARING_LITTLE_ENDIAN 1
+#endif
+
+enum
+{
+	ROARING_ARRAY = 1,
+	ROARING_BITMAP = 2,
+	ROARING_RUN = 3
+};
+
+/* The values [start, last] */
+typedef struct {
+	uint16_t start;
+	uint16_t last;
+} roaring_run;
+
+typedef struct {
+	uint16_t key;  /* high 16 bits of every value in the container */
+	uint8_t type;  /* ROARING_ARRAY, ROARING_BITMAP or ROARING_RUN */
+	uint8_t owned; /* data is ours to free (not a mapped buffer) */
+	uint32_t card; /* number of values, 1..65536 */
+	uint32_t n;    /* entries of data: values or runs */
+	uint32_t cap;  /* allocated entries of data */
+	void *data;
+} roaring_container;
+
+struct roaring_s {
+	roaring_container *c;
+	size_t n;
+	size_t cap;
+	bool frozen;
+};
+
+#define rc_array(c) ((uint16_t *)(c)->data)
+#define rc_words(c) ((uint64_t *)(c)->data)
+#define rc_runs(c)  ((roaring_run *)(c)->data)
+
+#define ROARING_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static uint32_t roaring_popcount(const uint64_t *w, size_t n);
+
+/* ---------------------------- word helpers ---------------------------- */
+
+static void
+words_set_range(uint64_t *w, uint32_t first, uint32_t last)
+{
+	size_t fw = first / 64, lw = last / 64;
+	uint64_t fm = ~(uint64_t)0 << (first % 64);
+	uint64_t lm = ~(uint64_t)0 >> (63 - last % 64);
+
+	if (fw == lw)
+	{
+		w[fw] |= fm & lm;
+		return;
+	}
+
+	w[fw] |= fm;
+	for (size_t i = fw + 1; i < lw; i++)
+		w[i] = ~(uint64_t)0;
+	w[lw] |= lm;
+}
+
+/* First bit at or after `from` that is set (or clear), 65536 if none */
+static uint32_t
+words_next(const uint64_t *w, uint32_t from, bool set)
+{
+	if (from >= ROARING_BITMAP_WORDS * 64)
+		return ROARING_BITMAP_WORDS * 64;
+
+	size_t i = from / 64;
+	uint64_t x = (set ? w[i] : ~w[i]) & (~(uint64_t)0 << (from % 64));
+	while (x == 0)
+	{
+		if (++i == ROARING_BITMAP_WORDS)
+			return ROARING_BITMAP_WORDS * 64;
+		x = set ? w[i] : ~w[i];
+	}
+	return (uint32_t)(i * 64 + (size_t)__builtin_ctzll(x));
+}
+
+/* ---------------------------- containers ---------------------------- */
+
+static void
+container_release(roaring_container *c)
+{
+	if (c->owned)
+		free(c->data);
+	c->data = NULL;
+	c->n = c->cap = 0;
+}
+
+static bool
+container_contains(const roaring_container *c, uint16_t v)
+{
+	if (c->type == ROARING_BITMAP)
+		return (rc_words(c)[v / 64] >> (v % 64)) & 1;
+
+	size_t lo = 0, hi = c->n;
+	if (c->type == ROARING_ARRAY)
+	{
+		const uint16_t *a = rc_array(c);
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (a[mid] == v)
+				return true;
+			if (a[mid] < v)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return false;
+	}
+
+	/* Last run starting at or before v */
+	const roaring_run *r = rc_runs(c);
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (r[mid].start <= v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo > 0 && v <= r[lo - 1].last;
+}
+
+/* OR the values of c into a 1024-word bitmap */
+static void
+container_fill_words(const roaring_container *c, uint64_t *w)
+{
+	switch (c->type)
+	{
+	case ROARING_ARRAY:
+		for (uint32_t i = 0; i < c->n; i++)
+			w[rc_array(c)[i] / 64] |= (uint64_t)1 << (rc_array(c)[i] % 64);
+		break;
+	case ROARING_BITMAP:
+		for (size_t i = 0; i < ROARING_BITMAP_WORDS; i++)
+			w[i] |= rc_words(c)[i];
+		break;
+	case ROARING_RUN:
+		for (uint32_t i = 0; i < c->n; i++)
+			words_set_range(w, rc_runs(c)[i].start, rc_runs(c)[i].last);
+		break;
+	}
+}
+
+/* The container as a bitmap, materialized in tmp unless it is one */
+static const uint64_t *
+container_words(const roaring_container *c, uint64_t *tmp)
+{
+	if (c->type == ROARING_BITMAP)
+		return rc_words(c);
+
+	memset(tmp, 0, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+	container_fill_words(c, tmp);
+	return tmp;
+}
+
+/* Write the values of c, ascending, to out (c->card entries) */
+static void
+container_extract(const roaring_container *c, uint16_t *out)
+{
+	size_t k = 0;
+
+	switch (c->type)
+	{
+	case ROARING_ARRAY:
+		memcpy(out, c->data, c->n * sizeof(uint16_t));
+		break;
+	case ROARING_BITMAP:
+		for (size_t i = 0; i < ROARING_BITMAP_WORDS; i++)
+		{
+			for (uint64_t w = rc_words(c)[i]; w; w &= w - 1)
+				out[k++] = (uint16_t)(i * 64 + (size_t)__builtin_ctzll(w));
+		}
+		break;
+	case ROARING_RUN:
+		for (uint32_t i = 0; i < c->n; i++)
+		{
+			for (uint32_t v = rc_runs(c)[i].start; v <= rc_runs(c)[i].last; v++)
+				out[k++] = (uint16_t)v;
+		}
+		break;
+	}
+}
+
+static bool
+container_to_bitmap(roaring_container *c)
+{
+	uint64_t *w = (uint64_t *)calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+	if (w == NULL)
+		return false;
+
+	container_fill_words(c, w);
+	container_release(c);
+	c->type = ROARING_BITMAP;
+	c->owned = 1;
+	c->data = w;
+	c->cap = ROARING_BITMAP_WORDS;
+	return true;
+}
+
+static bool
+container_to_array(roaring_container *c)
+{
+	uint16_t *a = (uint16_t *)malloc((c->card ? c->card : 1) * sizeof(uint16_t));
+	if (a == NULL)
+		return false;
+
+	container_extract(c, a);
+	container_release(c);
+	c->type = ROARING_ARRAY;
+	c->owned = 1;
+	c->data = a;
+	c->n = c->cap = c->card;
+	return true;
+}
+
+/* Leave run encoding before modifying a container */
+static bool
+container_unrun(roaring_container *c)
+{
+	if (c->type != ROARING_RUN)
+		return true;
+
+	return c->card <= ROARING_ARRAY_MAX ? container_to_array(c)
+					    : container_to_bitmap(c);
+}
+
+/* A bitmap that got small enough becomes an array; failure to shrink
+ * leaves a valid bitmap behind. */
+static void
+container_normalize(roaring_container *c)
+{
+	if (c->type == ROARING_BITMAP && c->card <= ROARING_ARRAY_MAX)
+		container_to_array(c);
+}
+
+static uint32_t
+container_count_runs(const roaring_container *c)
+{
+	uint32_t runs = 0;
+
+	switch (c->type)
+	{
+	case ROARING_ARRAY:
+		for (uint32_t i = 0; i < c->n; i++)
+			runs += i == 0 || rc_array(c)[i] != rc_array(c)[i - 1] + 1;
+		break;
+	case ROARING_BITMAP:
+	{
+		/* A run starts at every set bit whose predecessor is clear */
+		uint64_t carry = 0;
+		for (size_t i = 0; i < ROARING_BITMAP_WORDS; i++)
+		{
+			uint64_t w = rc_words(c)[i];
+			uint64_t starts = w & ~((w << 1) | carry);
+			runs += roaring_popcount(&starts, 1);
+			carry = w >> 63;
+		}
+		break;
+	}
+	case ROARING_RUN:
+		runs = c->n;
+		break;
+	}
+
+	return runs;
+}
+
+static bool
+container_to_run(roaring_container *c, uint32_t nruns)
+{
+	roaring_run *r = (roaring_run *)malloc(nruns * sizeof(roaring_run));
+	if (r == NULL)
+		return false;
+
+	uint32_t k = 0;
+	if (c->type == ROARING_ARRAY)
+	{
+		const uint16_t *a = rc_array(c);
+		for (uint32_t i = 0; i < c->n; i++)
+		{
+			if (i == 0 || a[i] != a[i - 1] + 1)
+				r[k++].start = a[i];
+			r[k - 1].last = a[i];
+		}
+	}
+	else
+	{
+		const uint64_t *w = rc_words(c);
+		uint32_t pos = words_next(w, 0, true);
+		while (pos < ROARING_BITMAP_WORDS * 64)
+		{
+			uint32_t end = words_next(w, pos, false);
+			r[k].start = (uint16_t)pos;
+			r[k].last = (uint16_t)(end - 1);
+			k++;
+			pos = words_next(w, end, true);
+		}
+	}
+
+	container_release(c);
+	c->type = ROARING_RUN;
+	c->owned = 1;
+	c->data = r;
+	c->n = c->cap = nruns;
+	return true;
+}
+
+static int
+container_add(roaring_container *c, uint16_t v)
+{
+	if (c->type == ROARING_RUN)
+	{
+		if (container_contains(c, v))
+			return 0;
+		if (!container_unrun(c))
+			return -1;
+	}
+
+	if (c->type == ROARING_BITMAP)
+	{
+		uint64_t m = (uint64_t)1 << (v % 64);
+		if (rc_words(c)[v / 64] & m)
+			return 0;
+		rc_words(c)[v / 64] |= m;
+		c->card++;
+		return 1;
+	}
+
+	uint16_t *a = rc_array(c);
+	size_t lo = 0, hi = c->n;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (a[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < c->n && a[lo] == v)
+		return 0;
+
+	if (c->card >= ROARING_ARRAY_MAX)
+	{
+		if (!container_to_bitmap(c))
+			return -1;
+		return container_add(c, v);
+	}
+
+	if (c->n == c->cap)
+	{
+		uint32_t cap = c->cap ? ROARING_MIN(c->cap * 2, ROARING_ARRAY_MAX) : 4;
+		a = (uint16_t *)realloc(c->data, cap * sizeof(uint16_t));
+		if (a == NULL)
+			return -1;
+		c->data = a;
+		c->cap = cap;
+	}
+
+	memmove(a + lo + 1, a + lo, (c->n - lo) * sizeof(uint16_t));
+	a[lo] = v;
+	c->n++;
+	c->card++;
+	return 1;
+}
+
+static int
+container_remove(roaring_container *c, uint16_t v)
+{
+	if (!container_contains(c, v))
+		return 0;
+	if (!container_unrun(c))
+		return -1;
+
+	if (c->type == ROARING_BITMAP)
+	{
+		rc_words(c)[v / 64] &= ~((uint64_t)1 << (v % 64));
+		c->card--;
+		if (c->card > 0)
+			container_normalize(c);
+		return 1;
+	}
+
+	uint16_t *a = rc_array(c);
+	size_t lo = 0, hi = c->n;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (a[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	memmove(a + lo, a + lo + 1, (c->n - lo - 1) * sizeof(uint16_t));
+	c->n--;
+	c->card--;
+	return 1;
+}
+
+static size_t
+container_data_size(const roaring_container *c)
+{
+	switch (c->type)
+	{
+	case ROARING_ARRAY:
+		return c->n * sizeof(uint16_t);
+	case ROARING_BITMAP:
+		return ROARING_BITMAP_WORDS * sizeof(uint64_t);
+	default:
+		return c->n * sizeof(roaring_run);
+	}
+}
+
+static bool
+container_clone(const roaring_container *src, roaring_container *dst)
+{
+	size_t size = container_data_size(src);
+
+	*dst = *src;
+	dst->data = malloc(size ? size : 1);
+	if (dst->data == NULL)
+		return false;
+
+	memcpy(dst->data, src->data, size);
+	dst->owned = 1;
+	dst->cap = src->type == ROARING_BITMAP ? ROARING_BITMAP_WORDS : src->n;
+	return true;
+}
+
+/* out = a & b; out->card is 0 when the intersection is empty */
+static bool
+container_and(const roaring_container *a,
+	      const roaring_container *b,
+	      roaring_container *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->key = a->key;
+	out->owned = 1;
+
+	if (a->type == ROARING_ARRAY || b->type == ROARING_ARRAY)
+	{
+		const roaring_container *arr = a->type == ROARING_ARRAY ? a : b;
+		const roaring_container *other = arr == a ? b : a;
+		uint16_t *res = (uint16_t *)malloc((arr->n ? arr->n : 1) * sizeof(uint16_t));
+		if (res == NULL)
+			return false;
+
+		uint32_t k = 0;
+		if (other->type == ROARING_ARRAY)
+		{
+			const uint16_t *x = rc_array(arr), *y = rc_array(other);
+			uint32_t i = 0, j = 0;
+			while (i < arr->n && j < other->n)
+			{
+				if (x[i] < y[j])
+					i++;
+				else if (x[i] > y[j])
+					j++;
+				else
+				{
+					res[k++] = x[i];
+					i++;
+					j++;
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < arr->n; i++)
+			{
+				if (container_contains(other, rc_array(arr)[i]))
+					res[k++] = rc_array(arr)[i];
+			}
+		}
+
+		out->type = ROARING_ARRAY;
+		out->data = res;
+		out->n = out->card = k;
+		out->cap = arr->n;
+		return true;
+	}
+
+	uint64_t ta[ROARING_BITMAP_WORDS], tb[ROARING_BITMAP_WORDS];
+	const uint64_t *wa = container_words(a, ta), *wb = container_words(b, tb);
+	uint64_t *w = (uint64_t *)malloc(ROARING_BITMAP_WORDS * sizeof(uint64_t));
+	if (w == NULL)
+		return false;
+
+	for (size_t i = 0; i < ROARING_BITMAP_WORDS; i++)
+		w[i] = wa[i] & wb[i];
+
+	out->type = ROARING_BITMAP;
+	out->data = w;
+	out->cap = ROARING_BITMAP_WORDS;
+	out->card = roaring_popcount(w, ROARING_BITMAP_WORDS);
+	container_normalize(out);
+	return true;
+}
+
+static bool
+container_or(const roaring_container *a,
+	     const roaring_container *b,
+	     roaring_container *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->key = a->key;
+	out->owned = 1;
+
+	if (a->type == ROARING_ARRAY && b->type == ROARING_ARRAY &&
+	    a->n + b->n <= ROARING_ARRAY_MAX)
+	{
+		uint16_t *res = (uint16_t *)malloc((a->n + b->n) * sizeof(uint16_t));
+		if (res == NULL)
+			return false;
+
+		const uint16_t *x = rc_array(a), *y = rc_array(b);
+		uint32_t i = 0, j = 0, k = 0;
+		while (i < a->n && j < b->n)
+		{
+			if (x[i] < y[j])
+				res[k++] = x[i++];
+			else if (x[i] > y[j])
+				res[k++] = y[j++];
+			else
+			{
+				res[k++] = x[i++];
+				j++;
+			}
+		}
+		while (i < a->n)
+			res[k++] = x[i++];
+		while (j < b->n)
+			res[k++] = y[j++];
+
+		out->type = ROARING_ARRAY;
+		out->data = res;
+		out->n = out->card = k;
+		out->cap = a->n + b->n;
+		return true;
+	}
+
+	uint64_t *w = (uint64_t *)calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+	if (w == NULL)
+		return false;
+
+	container_fill_words(a, w);
+	container_fill_words(b, w);
+
+	out->type = ROARING_BITMAP;
+	out->data = w;
+	out->cap = ROARING_BITMAP_WORDS;
+	out->card = roaring_popcount(w, ROARING_BITMAP_WORDS);
+	container_normalize(out);
+	return true;
+}
+
+static uint32_t
+container_and_cardinality(const roaring_container *a, const roaring_container *b)
+{
+	if (a->type == ROARING_ARRAY || b->type == ROARING_ARRAY)
+	{
+		const roaring_container *arr = a->type == ROARING_ARRAY ? a : b;
+		const roaring_container *other = arr == a ? b : a;
+		uint32_t k = 0;
+		for (uint32_t i = 0; i < arr->n; i++)
+			k += container_contains(other, rc_array(arr)[i]);
+		return k;
+	}
+
+	uint64_t ta[ROARING_BITMAP_WORDS], tb[ROARING_BITMAP_WORDS];
+	const uint64_t *wa = container_words(a, ta), *wb = container_words(b, tb);
+	uint32_t k = 0;
+	for (size_t i = 0; i < ROARING_BITMAP_WORDS; i++)
+	{
+		uint64_t w = wa[i] & wb[i];
+		k += roaring_popcount(&w, 1);
+	}
+	return k;
+}
+
+/* ---------------------------- bitmap level ---------------------------- */
+
+/* Index of the first container whose key is >= key */
+static size_t
+roaring_lower_bound(const roaring_t *r, uint16_t key)
+{
+	size_t lo = 0, hi = r->n;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (r->c[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static roaring_container *
+roaring_get(const roaring_t *r, uint16_t key)
+{
+	size_t i = roaring_lower_bound(r, key);
+	return i < r->n && r->c[i].key == key ? &r->c[i] : NULL;
+}
+
+static bool
+roaring_reserve(roaring_t *r, size_t n)
+{
+	if (n <= r->cap)
+		return true;
+
+	size_t cap = r->cap ? r->cap * 2 : 4;
+	while (cap < n)
+		cap *= 2;
+
+	roaring_container *c = (roaring_container *)realloc(r->c, cap * sizeof(*c));
+	if (c == NULL)
+		return false;
+
+	r->c = c;
+	r->cap = cap;
+	return true;
+}
+
+/* Insert an empty array container for key at position i */
+static roaring_container *
+roaring_insert(roaring_t *r, size_t i, uint16_t key)
+{
+	if (!roaring_reserve(r, r->n + 1))
+		return NULL;
+
+	memmove(r->c + i + 1, r->c + i, (r->n - i) * sizeof(roaring_container));
+	memset(&r->c[i], 0, sizeof(roaring_container));
+	r->c[i].key = key;
+	r->c[i].type = ROARING_ARRAY;
+	r->c[i].owned = 1;
+	r->n++;
+	return &r->c[i];
+}
+
+static void
+roaring_drop(roaring_t *r, size_t i)
+{
+	container_release(&r->c[i]);
+	memmove(r->c + i, r->c + i + 1, (r->n - i - 1) * sizeof(roaring_container));
+	r->n--;
+}
+
+/* Append a container built in key order; frees it on failure */
+static bool
+roaring_push(roaring_t *r, roaring_container *c)
+{
+	if (!roaring_reserve(r, r->n + 1))
+	{
+		container_release(c);
+		return false;
+	}
+
+	r->c[r->n++] = *c;
+	return true;
+}
+
+roaring_t *
+roaring_new(void)
+{
+	return (roaring_t *)calloc(1, sizeof(roaring_t));
+}
+
+void
+roaring_free(roaring_t *r)
+{
+	if (r == NULL)
+		return;
+
+	for (size_t i = 0; i < r->n; i++)
+		container_release(&r->c[i]);
+	free(r->c);
+	free(r);
+}
+
+roaring_t *
+roaring_copy(const roaring_t *r)
+{
+	roaring_t *out = roaring_new();
+	if (out == NULL || !roaring_reserve(out, r->n))
+		goto fail;
+
+	for (size_t i = 0; i < r->n; i++)
+	{
+		if (!container_clone(&r->c[i], &out->c[i]))
+			goto fail;
+		out->n++;
+	}
+	return out;
+
+fail:
+	roaring_free(out);
+	return NULL;
+}
+
+int
+roaring_add(roaring_t *r, uint32_t value)
+{
+	if (r->frozen)
+		return -1;
+
+	uint16_t key = (uint16_t)(value >> 16);
+	size_t i = roaring_lower_bound(r, key);
+	roaring_container *c = i < r->n && r->c[i].key == key ? &r->c[i]
+							      : roaring_insert(r, i, key);
+	if (c == NULL)
+		return -1;
+
+	int ret = container_add(c, (uint16_t)value);
+	if (c->card == 0)
+		roaring_drop(r, i);
+	return ret;
+}
+
+int
+roaring_add_range(roaring_t *r, uint32_t first, uint32_t last)
+{
+	if (r->frozen)
+		return -1;
+	if (first > last)
+		return 0;
+
+	for (uint32_t key = first >> 16; key <= last >> 16; key++)
+	{
+		uint16_t lo = key == first >> 16 ? (uint16_t)first : 0;
+		uint16_t hi = key == last >> 16 ? (uint16_t)last : 0xffff;
+		size_t i = roaring_lower_bound(r, (uint16_t)key);
+		roaring_container *c;
+
+		if (i == r->n || r->c[i].key != key)
+		{
+			/* A fresh chunk holds exactly one run */
+			roaring_run *run = (roaring_run *)malloc(sizeof(roaring_run));
+			if (run == NULL || (c = roaring_insert(r, i, (uint16_t)key)) == NULL)
+			{
+				free(run);
+				return -1;
+			}
+			run->start = lo;
+			run->last = hi;
+			c->type = ROARING_RUN;
+			c->data = run;
+			c->n = c->cap = 1;
+			c->card = (uint32_t)hi - lo + 1;
+		}
+		else
+		{
+			c = &r->c[i];
+			if (c->type != ROARING_BITMAP && !container_to_bitmap(c))
+				return -1;
+			words_set_range(rc_words(c), lo, hi);
+			c->card = roaring_popcount(rc_words(c), ROARING_BITMAP_WORDS);
+			container_normalize(c);
+		}
+
+		if (key == 0xffff)
+			break;
+	}
+
+	return 0;
+}
+
+int
+roaring_remove(roaring_t *r, uint32_t value)
+{
+	if (r->frozen)
+		return -1;
+
+	uint16_t key = (uint16_t)(value >> 16);
+	size_t i = roaring_lower_bound(r, key);
+	if (i == r->n || r->c[i].key != key)
+		return 0;
+
+	int ret = container_remove(&r->c[i], (uint16_t)value);
+	if (r->c[i].card == 0)
+		roaring_drop(r, i);
+	return ret;
+}
+
+bool
+roaring_contains(const roaring_t *r, uint32_t value)
+{
+	const roaring_container *c = roaring_get(r, (uint16_t)(value >> 16));
+	return c != NULL && container_contains(c, (uint16_t)value);
+}
+
+uint64_t
+roaring_cardinality(const roaring_t *r)
+{
+	uint64_t card = 0;
+	for (size_t i = 0; i < r->n; i++)
+		card += r->c[i].card;
+	return card;
+}
+
+bool
+roaring_is_empty(const roaring_t *r)
+{
+	return r->n == 0;
+}
+
+roaring_t *
+roaring_and(const roaring_t *a, const roaring_t *b)
+{
+	roaring_t *out = roaring_new();
+	if (out == NULL)
+		return NULL;
+
+	size_t i = 0, j = 0;
+	while (i < a->n && j < b->n)
+	{
+		if (a->c[i].key < b->c[j].key)
+			i++;
+		else if (a->c[i].key > b->c[j].key)
+			j++;
+		else
+		{
+			roaring_container c;
+			if (!container_and(&a->c[i], &b->c[j], &c))
+				goto fail;
+			if (c.card == 0)
+				container_release(&c);
+			else if (!roaring_push(out, &c))
+				goto fail;
+			i++;
+			j++;
+		}
+	}
+	return out;
+
+fail:
+	roaring_free(out);
+	return NULL;
+}
+
+roaring_t *
+roaring_or(const roaring_t *a, const roaring_t *b)
+{
+	roaring_t *out = roaring_new();
+	if (out == NULL)
+		return NULL;
+
+	size_t i = 0, j = 0;
+	while (i < a->n || j < b->n)
+	{
+		roaring_container c;
+		bool ok;
+
+		if (j == b->n || (i < a->n && a->c[i].key < b->c[j].key))
+			ok = container_clone(&a->c[i++], &c);
+		else if (i == a->n || a->c[i].key > b->c[j].key)
+			ok = container_clone(&b->c[j++], &c);
+		else
+			ok = container_or(&a->c[i++], &b->c[j++], &c);
+
+		if (!ok || !roaring_push(out, &c))
+			goto fail;
+	}
+	return out;
+
+fail:
+	roaring_free(out);
+	return NULL;
+}
+
+uint64_t
+roaring_and_cardinality(const roaring_t *a, const roaring_t *b)
+{
+	uint64_t card = 0;
+	size_t i = 0, j = 0;
+
+	while (i < a->n && j < b->n)
+	{
+		if (a->c[i].key < b->c[j].key)
+			i++;
+		else if (a->c[i].key > b->c[j].key)
+			j++;
+		else
+			card += container_and_cardinality(&a->c[i++], &b->c[j++]);
+	}
+	return card;
+}
+
+int
+roaring_run_optimize(roaring_t *r)
+{
+	if (r->frozen)
+		return -1;
+
+	for (size_t i = 0; i < r->n; i++)
+	{
+		roaring_container *c = &r->c[i];
+		uint32_t runs = container_count_runs(c);
+		size_t run_size = runs * sizeof(roaring_run);
+		size_t plain_size = c->card <= ROARING_ARRAY_MAX
+					? c->card * sizeof(uint16_t)
+					: ROARING_BITMAP_WORDS * sizeof(uint64_t);
+
+		if (run_size < plain_size)
+		{
+			if (c->type != ROARING_RUN && !container_to_run(c, runs))
+				return -1;
+		}
+		else if (!container_unrun(c))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+bool
+roaring_iterate(const roaring_t *r, roaring_iterator_callback fn, void *ctx)
+{
+	for (size_t i = 0; i < r->n; i++)
+	{
+		const roaring_container *c = &r->c[i];
+		uint32_t base = (uint32_t)c->key << 16;
+
+		switch (c->type)
+		{
+		case ROARING_ARRAY:
+			for (uint32_t k = 0; k < c->n; k++)
+			{
+				if (!fn(base | rc_array(c)[k], ctx))
+					return false;
+			}
+			break;
+		case ROARING_BITMAP:
+			for (size_t k = 0; k < ROARING_BITMAP_WORDS; k++)
+			{
+				for (uint64_t w = rc_words(c)[k]; w; w &= w - 1)
+				{
+					if (!fn(base + (uint32_t)(k * 64) +
+						    (uint32_t)__builtin_ctzll(w),
+						ctx))
+						return false;
+				}
+			}
+			break;
+		case ROARING_RUN:
+			for (uint32_t k = 0; k < c->n; k++)
+			{
+				for (uint32_t v = rc_runs(c)[k].start; v <= rc_runs(c)[k].last; v++)
+				{
+					if (!fn(base | v, ctx))
+						return false;
+				}
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+static bool
+roaring_store_value(uint32_t value, void *ctx)
+{
+	uint32_t **out = (uint32_t **)ctx;
+	*(*out)++ = value;
+	return true;
+}
+
+void
+roaring_to_uint32_array(const roaring_t *r, uint32_t *out)
+{
+	roaring_iterate(r, roaring_store_value, &out);
+}
+
+roaring_t *
+roaring_from_bitset(const bitset_t *bs)
+{
+	roaring_t *r = roaring_new();
+	if (r == NULL)
+		return NULL;
+
+	size_t nwords = BITSET_WORDS(bs->length);
+	for (size_t base = 0; base < nwords; base += ROARING_BITMAP_WORDS)
+	{
+		const uint64_t *w = bs->data + base;
+		size_t n = ROARING_MIN(nwords - base, ROARING_BITMAP_WORDS);
+		uint32_t card = roaring_popcount(w, n);
+		if (card == 0)
+			continue;
+
+		roaring_container c;
+		memset(&c, 0, sizeof(c));
+		c.key = (uint16_t)(base / ROARING_BITMAP_WORDS);
+		c.owned = 1;
+		c.card = card;
+
+		if (card > ROARING_ARRAY_MAX)
+		{
+			c.data = calloc(ROARING_BITMAP_WORDS, sizeof(uint64_t));
+			if (c.data == NULL)
+				goto fail;
+			memcpy(c.data, w, n * sizeof(uint64_t));
+			c.type = ROARING_BITMAP;
+			c.cap = ROARING_BITMAP_WORDS;
+		}
+		else
+		{
+			uint16_t *a = (uint16_t *)malloc(card * sizeof(uint16_t));
+			if (a == NULL)
+				goto fail;
+			uint32_t k = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				for (uint64_t x = w[i]; x; x &= x - 1)
+					a[k++] = (uint16_t)(i * 64 + (size_t)__builtin_ctzll(x));
+			}
+			c.type = ROARING_ARRAY;
+			c.data = a;
+			c.n = c.cap = card;
+		}
+
+		if (!roaring_push(r, &c))
+			goto fail;
+	}
+	return r;
+
+fail:
+	roaring_free(r);
+	return NULL;
+}
+
+bitset_t *
+roaring_to_bitset(const roaring_t *r)
+{
+	if (r->n == 0)
+		return bitset_new(0);
+
+	/* The largest value decides the length */
+	const roaring_container *last = &r->c[r->n - 1];
+	uint32_t max;
+	switch (last->type)
+	{
+	case ROARING_ARRAY:
+		max = rc_array(last)[last->n - 1];
+		break;
+	case ROARING_RUN:
+		max = rc_runs(last)[last->n - 1].last;
+		break;
+	default:
+	{
+		size_t k = ROARING_BITMAP_WORDS;
+		while (rc_words(last)[k - 1] == 0)
+			k--;
+		max = (uint32_t)((k - 1) * 64 + 63 -
+				 (size_t)__builtin_clzll(rc_words(last)[k - 1]));
+		break;
+	}
+	}
+
+	size_t length = ((size_t)last->key << 16) + max + 1;
+	bitset_t *bs = bitset_new(length);
+	if (bs == NULL)
+		return NULL;
+
+	size_t nwords = BITSET_WORDS(length);
+	for (size_t i = 0; i < r->n; i++)
+	{
+		const roaring_container *c = &r->c[i];
+		size_t base = (size_t)c->key * ROARING_BITMAP_WORDS;
+
+		if (c->type == ROARING_BITMAP)
+			memcpy(bs->data + base,
+			       c->data,
+			       ROARING_MIN(nwords - base, ROARING_BITMAP_WORDS) *
+				   sizeof(uint64_t));
+		else
+			container_fill_words(c, bs->data + base);
+	}
+	return bs;
+}
+
+/* ---------------------------- serialization ---------------------------- */
+
+static void
+roaring_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void
+roaring_put32(uint8_t *p, uint32_t v)
+{
+	roaring_put16(p, (uint16_t)v);
+	roaring_put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void
+roaring_put64(uint8_t *p, uint64_t v)
+{
+	roaring_put32(p, (uint32_t)v);
+	roaring_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t
+roaring_get16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t
+roaring_get32(const uint8_t *p)
+{
+	return roaring_get16(p) | (uint32_t)roaring_get16(p + 2) << 16;
+}
+
+static uint64_t
+roaring_get64(const uint8_t *p)
+{
+	return roaring_get32(p) | (uint64_t)roaring_get32(p + 4) << 32;
+}
+
+#define ROARING_ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+size_t
+roaring_serialized_size(const roaring_t *r)
+{
+	size_t size = ROARING_HEADER_SIZE + r->n * ROARING_DESC_SIZE;
+	for (size_t i = 0; i < r->n; i++)
+		size += ROARING_ALIGN8(container_data_size(&r->c[i]));
+	return size;
+}
+
+/*
+ * Layout:
+ *   header      magic[8], u32 container count, u32 reserved
+ *   descriptor  u16 key, u16 type, u32 card, u32 entries, u32 reserved,
+ *               u64 payload offset (one per container)
+ *   payloads    u16 values, u64 words or u16 start/last pairs
+ */
+size_t
+roaring_serialize(const roaring_t *r, void *buf)
+{
+	uint8_t *out = (uint8_t *)buf;
+	size_t offset = ROARING_HEADER_SIZE + r->n * ROARING_DESC_SIZE;
+	TRACE_BEGIN_N(span, "roaring_serialize", r->n);
+
+	memcpy(out, ROARING_MAGIC, 8);
+	roaring_put32(out + 8, (uint32_t)r->n);
+	roaring_put32(out + 12, 0);
+
+	for (size_t i = 0; i < r->n; i++)
+	{
+		const roaring_container *c = &r->c[i];
+		uint8_t *d = out + ROARING_HEADER_SIZE + i * ROARING_DESC_SIZE;
+		size_t size = container_data_size(c);
+
+		roaring_put16(d, c->key);
+		roaring_put16(d + 2, c->type);
+		roaring_put32(d + 4, c->card);
+		roaring_put32(d + 8, c->n);
+		roaring_put32(d + 12, 0);
+		roaring_put64(d + 16, offset);
+
+#ifdef ROARING_LITTLE_ENDIAN
+		memcpy(out + offset, c->data, size);
+#else
+		if (c->type == ROARING_BITMAP)
+		{
+			for (size_t k = 0; k < ROARING_BITMAP_WORDS; k++)
+				roaring_put64(out + offset + k * 8, rc_words(c)[k]);
+		}
+		else
+		{
+			/* Arrays and runs are both plain u16 sequences */
+			const uint16_t *v = (const uint16_t *)c->data;
+			for (size_t k = 0; k < size / 2; k++)
+				roaring_put16(out + offset + k * 2, v[k]);
+		}
+#endif
+		memset(out + offset + size, 0, ROARING_ALIGN8(size) - size);
+		offset += ROARING_ALIGN8(size);
+	}
+
+	TRACE_END(span);
+	return offset;
+}
+
+/*
+ * Check a loaded container's payload against its descriptor: arrays must
+ * be strictly increasing, runs ordered and disjoint, and card must equal
+ * the number of values actually stored, as every operation sizes its
+ * buffers by card.
+ */
+static bool
+container_valid(const roaring_container *c)
+{
+	switch (c->type)
+	{
+	case ROARING_ARRAY:
+	{
+		const uint16_t *a = rc_array(c);
+		for (uint32_t k = 1; k < c->n; k++)
+			if (a[k] <= a[k - 1])
+				return false;
+		return true;
+	}
+	case ROARING_BITMAP:
+		return roaring_popcount(rc_words(c), ROARING_BITMAP_WORDS) == c->card;
+	case ROARING_RUN:
+	{
+		const roaring_run *runs = rc_runs(c);
+		uint32_t card = 0;
+		for (uint32_t k = 0; k < c->n; k++)
+		{
+			if (runs[k].last < runs[k].start ||
+			    (k > 0 && runs[k].start <= runs[k - 1].last))
+				return false;
+			card += (uint32_t)runs[k].last - runs[k].start + 1;
+		}
+		return card == c->card;
+	}
+	default:
+		return false;
+	}
+}
+
+/* Parse and validate buf; containers point into it when in_place */
+static roaring_t *
+roaring_load(const void *buf, size_t len, bool in_place)
+{
+	const uint8_t *in = (const uint8_t *)buf;
+	if (len < ROARING_HEADER_SIZE || memcmp(in, ROARING_MAGIC, 8) != 0)
+		return NULL;
+
+	size_t n = roaring_get32(in + 8);
+	if (n > 65536 || (len - ROARING_HEADER_SIZE) / ROARING_DESC_SIZE < n)
+		return NULL;
+
+	roaring_t *r = roaring_new();
+	if (r == NULL || !roaring_reserve(r, n))
+		goto fail;
+	r->frozen = in_place;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const uint8_t *d = in + ROARING_HEADER_SIZE + i * ROARING_DESC_SIZE;
+		roaring_container c;
+		memset(&c, 0, sizeof(c));
+		c.key = roaring_get16(d);
+		c.type = (uint8_t)roaring_get16(d + 2);
+		c.card = roaring_get32(d + 4);
+		c.n = roaring_get32(d + 8);
+		uint64_t offset = roaring_get64(d + 16);
+
+		bool ok;
+		switch (c.type)
+		{
+		case ROARING_ARRAY:
+			ok = c.n == c.card && c.n <= ROARING_ARRAY_MAX;
+			break;
+		case ROARING_BITMAP:
+			ok = c.n == 0 && c.card <= 65536;
+			break;
+		case ROARING_RUN:
+			ok = c.n <= 32768 && c.card <= 65536;
+			break;
+		default:
+			ok = false;
+			break;
+		}
+		size_t size = container_data_size(&c);
+		if (!ok || c.card == 0 || (i > 0 && c.key <= r->c[i - 1].key) ||
+		    offset > len || len - offset < size || offset % 8 != 0)
+			goto fail;
+
+		if (in_place)
+		{
+			c.data = (void *)(uintptr_t)(in + offset);
+		}
+		else
+		{
+			c.owned = 1;
+			c.cap = c.type == ROARING_BITMAP ? ROARING_BITMAP_WORDS : c.n;
+			c.data = malloc(size ? size : 1);
+			if (c.data == NULL)
+				goto fail;
+#ifdef ROARING_LITTLE_ENDIAN
+			memcpy(c.data, in + offset, size);
+#else
+			if (c.type == ROARING_BITMAP)
+			{
+				for (size_t k = 0; k < ROARING_BITMAP_WORDS; k++)
+					rc_words(&c)[k] = roaring_get64(in + offset + k * 8);
+			}
+			else
+			{
+				uint16_t *v = (uint16_t *)c.data;
+				for (size_t k = 0; k < size / 2; k++)
+					v[k] = roaring_get16(in + offset + k * 2);
+			}
+#endif
+		}
+		if (!container_valid(&c))
+		{
+			if (c.owned)
+				free(c.data);
+			goto fail;
+		}
+		r->c[r->n++] = c;
+	}
+	return r;
+
+fail:
+	roaring_free(r);
+	return NULL;
+}
+
+roaring_t *
+roaring_deserialize(const void *buf, size_t len)
+{
+	TRACE_BEGIN_N(span, "roaring_deserialize", len);
+	roaring_t *r = roaring_load(buf, len, false);
+	TRACE_END(span);
+	return r;
+}
+
+roaring_t *
+roaring_view(const void *buf, size_t len)
+{
+#ifdef ROARING_LITTLE_ENDIAN
+	if ((uintptr_t)buf % 8 == 0)
+		return roaring_load(buf, len, true);
+#endif
+	return roaring_load(buf, len, false);
+}
+
+/* ---------------------------- popcount ---------------------------- */
+
+static uint32_t
+roaring_popcount_generic(const uint64_t *w, size_t n)
+{
+	uint32_t count = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t x = w[i];
+		x = x - ((x >> 1) & 0x5555555555555555ULL);
+		x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+		x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		count += (uint32_t)((x * 0x0101010101010101ULL) >> 56);
+	}
+	return count;
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+NOSHIRO_TARGET("popcnt")
+static uint32_t
+roaring_popcount_popcnt(const uint64_t *w, size_t n)
+{
+	uint32_t count = 0;
+	for (size_t i = 0; i < n; i++)
+		count += (uint32_t)__builtin_popcountll(w[i]);
+	return count;
+}
+#endif
+
+static uint32_t
+roaring_popcount(const uint64_t *w, size_t n)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("popcnt"))
+		return roaring_popcount_popcnt(w, n);
+#endif
+	return roaring_popcount_generic(w, n);
+}
+
+#undef ROARING_MIN
+#undef ROARING_ALIGN8
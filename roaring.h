@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_ROARING_H__
+#define __NOSHIRO_ROARING_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+/*
+ * Compressed bitmap over the 32-bit integers (Roaring layout).
+ *
+ * Values are grouped by their high 16 bits into chunks of 65536. Each
+ * non-empty chunk is stored in the smallest fitting container: a sorted
+ * array of up to 4096 values, an 8KB bitmap, or a list of runs after
+ * roaring_run_optimize(). Sparse and clustered sets use a small fraction of
+ * the memory of a dense bitset_t of the same universe.
+ */
+typedef struct roaring_s roaring_t;
+
+/* Return false to stop the iteration */
+typedef bool (*roaring_iterator_callback)(uint32_t value, void *ctx);
+
+roaring_t *roaring_new(void);
+void roaring_free(roaring_t *r);
+roaring_t *roaring_copy(const roaring_t *r);
+
+/**
+ * Add a value.
+ *
+ * @return 1 if it was added, 0 if it was already present, -1 on failure
+ *         (out of memory, or @p r is a read-only view)
+ */
+int roaring_add(roaring_t *r, uint32_t value);
+
+/**
+ * Add every value in [first, last].
+ *
+ * @return 0 on success, -1 on failure
+ */
+int roaring_add_range(roaring_t *r, uint32_t first, uint32_t last);
+
+/**
+ * Remove a value.
+ *
+ * @return 1 if it was removed, 0 if it was absent, -1 on failure
+ */
+int roaring_remove(roaring_t *r, uint32_t value);
+
+bool roaring_contains(const roaring_t *r, uint32_t value);
+uint64_t roaring_cardinality(const roaring_t *r);
+bool roaring_is_empty(const roaring_t *r);
+
+/**
+ * Set algebra. The results are new, writable bitmaps (NULL on failure).
+ * The operands may be views.
+ */
+roaring_t *roaring_and(const roaring_t *a, const roaring_t *b);
+roaring_t *roaring_or(const roaring_t *a, const roaring_t *b);
+uint64_t roaring_and_cardinality(const roaring_t *a, const roaring_t *b);
+
+/**
+ * Switch every container to run encoding where that is smaller, and back
+ * where it is not.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int roaring_run_optimize(roaring_t *r);
+
+/**
+ * Call @p fn on every value in ascending order.
+ *
+ * @return false if the callback stopped the iteration
+ */
+bool roaring_iterate(const roaring_t *r, roaring_iterator_callback fn, void *ctx);
+
+/**
+ * Write all values in ascending order to @p out, which must hold
+ * roaring_cardinality() entries.
+ */
+void roaring_to_uint32_array(const roaring_t *r, uint32_t *out);
+
+/**
+ * Convert from and to a dense bitset. The bitset produced is one bit
+ * longer than the largest value (empty for an empty bitmap).
+ */
+roaring_t *roaring_from_bitset(const bitset_t *bs);
+bitset_t *roaring_to_bitset(const roaring_t *r);
+
+/*
+ * Serialization. The format is little-endian with every container payload
+ * 8-byte aligned, so a serialized bitmap can be written to a file, mapped
+ * back and used in place through roaring_view().
+ */
+size_t roaring_serialized_size(const roaring_t *r);
+
+/**
+ * @param buf buffer of at least roaring_serialized_size() bytes
+ * @return    the number of bytes written
+ */
+size_t roaring_serialize(const roaring_t *r, void *buf);
+
+/**
+ * Rebuild a bitmap from a serialized buffer, copying everything.
+ */
+roaring_t *roaring_deserialize(const void *buf, size_t len);
+
+/**
+ * Read-only bitmap whose containers point into @p buf, which must stay
+ * valid and unchanged while the view is used. No container is copied on
+ * little-endian hosts when @p buf is 8-byte aligned; otherwise this falls
+ * back to a copy. Modifying calls on a view fail.
+ */
+roaring_t *roaring_view(const void *buf, size_t len);
+
+#endif /* __NOSHIRO_ROARING_H__ */
@@ -20,11 +20,22 @@
  * IN THE SOFTWARE.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* mremap */
+#endif
+
 #include "sda.h"
+#include "stats.h"
+#include "trace.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define SDA_MIN(a, b) ((a) < (b) ? (a) : (b))
 #define SDA_MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -34,15 +45,42 @@ typedef struct {
 	size_t len;
 	size_t elt_capacity;
 	size_t elt_size;
+	size_t alignment; /* 0 when malloc alignment is enough */
 	sda_clear_callback clear_func;
+	/* File-backed arrays only */
+	int fd;
+	int map_flags;
+	char *map;
+	size_t map_size;
 } sda_t_real;
 
+#define SDA_MAP_MAPPED 0x1
+#define SDA_MAP_RDONLY 0x2
+
+#define SDA_MAP_MAGIC   "NSHSDA\0"
+#define SDA_MAP_VERSION 1
+
+/* On-disk header, followed by the elements at SDA_MAP_HEADER_SIZE */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t elt_size;
+	uint64_t len;
+	uint64_t capacity;
+} sda_map_header;
+
+#define SDA_MAP_HEADER_SIZE 64
+#define sda_map_hdr(array)  ((sda_map_header *)(void *)(array)->map)
+
 #define sda_elt_len(array, i) ((size_t)(array)->elt_size * (i))
 #define sda_elt_pos(array, i) ((array)->data + sda_elt_len((array), (i)))
 #define sda_elt_zero(array, pos, len) \
 	(memset(sda_elt_pos((array), pos), 0, sda_elt_len((array), len)))
 
-static void sda_maybe_expand(sda_t_real *array, size_t len);
+static bool sda_maybe_expand(sda_t_real *array, size_t len);
+static void sda_keep_run(sda_t_real *array, size_t *w, size_t start, size_t end);
+static void sda_compact_finish(sda_t_real *array, size_t w);
+static bool sda_map_expand(sda_t_real *array, size_t want_alloc);
 static size_t sda_nearest_pow(size_t v);
 
 sda_t *
@@ -54,15 +92,143 @@ sda_new(size_t element_size)
 	sda_t_real *array = (sda_t_real *)malloc(sizeof(sda_t_real));
 	if (!array)
 		return NULL;
+	NOSHIRO_STAT_ALLOC(sizeof(sda_t_real));
 
 	array->data = NULL;
 	array->len = 0;
 	array->elt_capacity = 0;
 	array->elt_size = element_size;
+	array->alignment = 0;
 	array->clear_func = 0;
+	array->fd = -1;
+	array->map_flags = 0;
+	array->map = NULL;
+	array->map_size = 0;
+	return (sda_t *)array;
+}
+
+sda_t *
+sda_new_aligned(size_t element_size, size_t alignment)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+	    alignment % sizeof(void *) != 0)
+		return NULL;
+
+	sda_t_real *array = (sda_t_real *)sda_new(element_size);
+	if (!array)
+		return NULL;
+
+	array->alignment = alignment;
 	return (sda_t *)array;
 }
 
+sda_t *
+sda_map_new(const char *path, size_t element_size)
+{
+	sda_t_real *array = (sda_t_real *)sda_new(element_size);
+	if (!array)
+		return NULL;
+
+	array->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (array->fd < 0)
+		goto fail;
+
+	if (ftruncate(array->fd, SDA_MAP_HEADER_SIZE) != 0)
+		goto fail;
+
+	array->map = mmap(NULL,
+			  SDA_MAP_HEADER_SIZE,
+			  PROT_READ | PROT_WRITE,
+			  MAP_SHARED,
+			  array->fd,
+			  0);
+	if (array->map == MAP_FAILED)
+		goto fail;
+
+	array->map_flags = SDA_MAP_MAPPED;
+	array->map_size = SDA_MAP_HEADER_SIZE;
+	array->data = array->map + SDA_MAP_HEADER_SIZE;
+
+	sda_map_header *hdr = sda_map_hdr(array);
+	memcpy(hdr->magic, SDA_MAP_MAGIC, sizeof(hdr->magic));
+	hdr->version = SDA_MAP_VERSION;
+	hdr->elt_size = (uint32_t)element_size;
+	hdr->len = 0;
+	hdr->capacity = 0;
+	return (sda_t *)array;
+
+fail:
+	if (array->fd >= 0)
+		close(array->fd);
+	free(array);
+	return NULL;
+}
+
+sda_t *
+sda_map_open(const char *path, bool read_only)
+{
+	int fd = open(path, read_only ? O_RDONLY : O_RDWR);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	sda_map_header hdr;
+	if (fstat(fd, &st) != 0 || st.st_size < SDA_MAP_HEADER_SIZE ||
+	    pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr))
+		goto fail;
+
+	/* The header is untrusted: bound capacity before multiplying */
+	if (memcmp(hdr.magic, SDA_MAP_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != SDA_MAP_VERSION || hdr.elt_size == 0 ||
+	    hdr.len > hdr.capacity ||
+	    hdr.capacity > (SIZE_MAX - SDA_MAP_HEADER_SIZE) / hdr.elt_size ||
+	    (uint64_t)st.st_size <
+		SDA_MAP_HEADER_SIZE + (uint64_t)hdr.capacity * hdr.elt_size)
+		goto fail;
+
+	sda_t_real *array = (sda_t_real *)sda_new(hdr.elt_size);
+	if (!array)
+		goto fail;
+
+	array->map = mmap(NULL,
+			  (size_t)st.st_size,
+			  read_only ? PROT_READ : PROT_READ | PROT_WRITE,
+			  MAP_SHARED,
+			  fd,
+			  0);
+	if (array->map == MAP_FAILED)
+	{
+		free(array);
+		goto fail;
+	}
+
+	array->fd = fd;
+	array->map_flags = SDA_MAP_MAPPED | (read_only ? SDA_MAP_RDONLY : 0);
+	array->map_size = (size_t)st.st_size;
+	array->data = array->map + SDA_MAP_HEADER_SIZE;
+	array->len = hdr.len;
+	array->elt_capacity = hdr.capacity;
+	return (sda_t *)array;
+
+fail:
+	close(fd);
+	return NULL;
+}
+
+int
+sda_map_sync(sda_t *a)
+{
+	sda_t_real *array = (sda_t_real *)a;
+	if (!array || !(array->map_flags & SDA_MAP_MAPPED))
+		return -1;
+
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return 0;
+
+	sda_map_hdr(array)->len = array->len;
+	return msync(array->map, array->map_size, MS_SYNC);
+}
+
 char *
 sda_free(sda_t *a, bool free_segment)
 {
@@ -71,7 +237,16 @@ sda_free(sda_t *a, bool free_segment)
 		return NULL;
 
 	char *segment;
-	if (free_segment)
+	if (array->map_flags & SDA_MAP_MAPPED)
+	{
+		/* The elements belong to the file, not to the caller */
+		if (!(array->map_flags & SDA_MAP_RDONLY))
+			sda_map_hdr(array)->len = array->len;
+		munmap(array->map, array->map_size);
+		close(array->fd);
+		segment = NULL;
+	}
+	else if (free_segment)
 	{
 		if (array->clear_func != NULL)
 		{
@@ -101,7 +276,8 @@ sda_append_vals(sda_t *a, void *data, size_t len)
 	if (len == 0)
 		return a;
 
-	sda_maybe_expand(array, len);
+	if (!sda_maybe_expand(array, len))
+		return NULL;
 	memcpy(sda_elt_pos(array, array->len), data, sda_elt_len(array, len));
 
 	array->len += len;
@@ -118,11 +294,13 @@ sda_prepend_vals(sda_t *a, void *data, size_t len)
 	if (len == 0)
 		return a;
 
-	sda_maybe_expand(array, len);
+	if (!sda_maybe_expand(array, len))
+		return NULL;
 
 	memmove(sda_elt_pos(array, len),
 		sda_elt_pos(array, 0),
 		sda_elt_len(array, array->len));
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_MOVE_BYTES, sda_elt_len(array, array->len));
 
 	memcpy(sda_elt_pos(array, 0), data, sda_elt_len(array, len));
 
@@ -145,15 +323,18 @@ sda_insert_vals(sda_t *a, size_t index_, void *data, size_t len)
 	 * over-allocate and clear some elements? */
 	if (index_ >= array->len)
 	{
-		sda_maybe_expand(array, index_ - array->len + len);
+		if (!sda_maybe_expand(array, index_ - array->len + len))
+			return NULL;
 		return sda_append_vals(sda_set_size(a, index_), data, len);
 	}
 
-	sda_maybe_expand(array, len);
+	if (!sda_maybe_expand(array, len))
+		return NULL;
 
 	memmove(sda_elt_pos(array, len + index_),
 		sda_elt_pos(array, index_),
 		sda_elt_len(array, array->len - index_));
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_MOVE_BYTES, sda_elt_len(array, array->len - index_));
 
 	memcpy(sda_elt_pos(array, index_), data, sda_elt_len(array, len));
 
@@ -171,10 +352,14 @@ sda_set_size(sda_t *a, size_t length)
 
 	if (length > array->len)
 	{
-		sda_maybe_expand(array, length - array->len);
+		if (!sda_maybe_expand(array, length - array->len))
+			return NULL;
 	}
 	else if (length < array->len)
-		sda_remove_range(a, length, array->len - length);
+	{
+		if (!sda_remove_range(a, length, array->len - length))
+			return NULL;
+	}
 
 	array->len = length;
 
@@ -187,6 +372,8 @@ sda_remove_range(sda_t *a, size_t index_, size_t length)
 	sda_t_real *array = (sda_t_real *)a;
 	if (!array)
 		return NULL;
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return NULL;
 	if (index_ > array->len)
 		return NULL;
 	if (index_ > UINT_MAX - length)
@@ -202,9 +389,13 @@ sda_remove_range(sda_t *a, size_t index_, size_t length)
 	}
 
 	if (index_ + length != array->len)
+	{
 		memmove(sda_elt_pos(array, index_),
 			sda_elt_pos(array, index_ + length),
 			(array->len - (index_ + length)) * array->elt_size);
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_MOVE_BYTES,
+				 (array->len - (index_ + length)) * array->elt_size);
+	}
 
 	array->len -= length;
 	sda_elt_zero(array, array->len, length);
@@ -212,6 +403,272 @@ sda_remove_range(sda_t *a, size_t index_, size_t length)
 	return a;
 }
 
+sda_t *
+sda_remove_if(sda_t *a, sda_predicate_callback pred, void *ctx)
+{
+	sda_t_real *array = (sda_t_real *)a;
+	if (!array || !pred)
+		return NULL;
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return NULL;
+
+	size_t w = 0, run = 0;
+	for (size_t i = 0; i < array->len; i++)
+	{
+		if (!pred(sda_elt_pos(array, i), ctx))
+			continue;
+
+		if (array->clear_func != NULL)
+			array->clear_func(sda_elt_pos(array, i));
+		sda_keep_run(array, &w, run, i);
+		run = i + 1;
+	}
+	sda_keep_run(array, &w, run, array->len);
+
+	sda_compact_finish(array, w);
+	return a;
+}
+
+sda_t *
+sda_remove_indices(sda_t *a, const size_t *indices, size_t count)
+{
+	sda_t_real *array = (sda_t_real *)a;
+	if (!array || (count > 0 && !indices))
+		return NULL;
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return NULL;
+
+	/* Validate up front so a bad list leaves the array untouched */
+	for (size_t k = 0; k < count; k++)
+	{
+		if (indices[k] >= array->len)
+			return NULL;
+		if (k > 0 && indices[k] < indices[k - 1])
+			return NULL;
+	}
+
+	size_t w = 0, run = 0;
+	for (size_t k = 0; k < count; k++)
+	{
+		size_t i = indices[k];
+		if (i < run) /* duplicate */
+			continue;
+
+		if (array->clear_func != NULL)
+			array->clear_func(sda_elt_pos(array, i));
+		sda_keep_run(array, &w, run, i);
+		run = i + 1;
+	}
+	sda_keep_run(array, &w, run, array->len);
+
+	sda_compact_finish(array, w);
+	return a;
+}
+
+sda_t *
+sda_remove_mask(sda_t *a, const bitset_t *mask)
+{
+	sda_t_real *array = (sda_t_real *)a;
+	if (!array || !mask)
+		return NULL;
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return NULL;
+
+	size_t w = 0, run = 0;
+	for (size_t i = bitset_next_set(mask, 0);
+	     i != BITSET_NPOS && i < array->len;
+	     i = bitset_next_set(mask, i + 1))
+	{
+		if (array->clear_func != NULL)
+			array->clear_func(sda_elt_pos(array, i));
+		sda_keep_run(array, &w, run, i);
+		run = i + 1;
+	}
+	sda_keep_run(array, &w, run, array->len);
+
+	sda_compact_finish(array, w);
+	return a;
+}
+
+sda_view_t
+sda_view(const sda_t *a)
+{
+	return sda_view_range(a, 0, a ? a->len : 0, 1);
+}
+
+sda_view_t
+sda_view_range(const sda_t *a, size_t start, size_t len, size_t step)
+{
+	const sda_t_real *array = (const sda_t_real *)a;
+	sda_view_t v = {NULL, 0, 0, 0, false};
+	if (!array)
+		return v;
+
+	v.data = array->data;
+	v.len = array->len;
+	v.stride = array->elt_size;
+	v.elt_size = array->elt_size;
+	v.read_only = (array->map_flags & SDA_MAP_RDONLY) != 0;
+	return sda_view_slice(&v, start, len, step);
+}
+
+sda_view_t
+sda_view_field(const sda_t *a, size_t offset, size_t size)
+{
+	const sda_t_real *array = (const sda_t_real *)a;
+	sda_view_t v = {NULL, 0, 0, 0, false};
+	if (!array || size == 0 || offset > array->elt_size ||
+	    size > array->elt_size - offset)
+		return v;
+
+	v.data = array->data + offset;
+	v.len = array->len;
+	v.stride = array->elt_size;
+	v.elt_size = size;
+	v.read_only = (array->map_flags & SDA_MAP_RDONLY) != 0;
+	return v;
+}
+
+sda_view_t
+sda_view_slice(const sda_view_t *v, size_t start, size_t len, size_t step)
+{
+	sda_view_t s = {NULL, 0, 0, 0, false};
+	if (!v || step == 0 || start >= v->len)
+		return s;
+
+	/* Elements start, start + step, ... that are still inside v */
+	size_t avail = (v->len - start - 1) / step + 1;
+
+	s.data = (char *)sda_view_elt(v, start);
+	s.len = SDA_MIN(len, avail);
+	s.stride = v->stride * step;
+	s.elt_size = v->elt_size;
+	s.read_only = v->read_only;
+	return s;
+}
+
+void
+sda_view_copy(const sda_view_t *v, void *out)
+{
+	if (!v || !out || v->len == 0)
+		return;
+
+	if (v->stride == v->elt_size)
+	{
+		memcpy(out, v->data, v->len * v->elt_size);
+		return;
+	}
+
+	char *dst = (char *)out;
+	for (size_t i = 0; i < v->len; i++, dst += v->elt_size)
+		memcpy(dst, sda_view_elt(v, i), v->elt_size);
+}
+
+sda_t *
+sda_view_to_sda(const sda_view_t *v)
+{
+	if (!v || v->elt_size == 0)
+		return NULL;
+
+	sda_t *a = sda_new(v->elt_size);
+	if (!a || (v->len > 0 && !sda_set_size(a, v->len)))
+	{
+		sda_free(a, true);
+		return NULL;
+	}
+
+	sda_view_copy(v, a->data);
+	return a;
+}
+
+int
+sda_view_sort(const sda_view_t *v, sda_compare_callback cmp)
+{
+	if (!v || !cmp || v->read_only)
+		return -1;
+	if (v->len < 2)
+		return 0;
+
+	TRACE_BEGIN_N(span, "sda_view_sort", v->len);
+	if (v->stride == v->elt_size)
+	{
+		qsort(v->data, v->len, v->elt_size, cmp);
+		TRACE_END(span);
+		return 0;
+	}
+
+	char *tmp = (char *)malloc(v->len * v->elt_size);
+	if (!tmp)
+	{
+		TRACE_END(span);
+		return -1;
+	}
+
+	sda_view_copy(v, tmp);
+	qsort(tmp, v->len, v->elt_size, cmp);
+	for (size_t i = 0; i < v->len; i++)
+		memcpy(sda_view_elt(v, i), tmp + i * v->elt_size, v->elt_size);
+
+	free(tmp);
+	TRACE_END(span);
+	return 0;
+}
+
+ptrdiff_t
+sda_view_bsearch(const sda_view_t *v, const void *key, sda_compare_callback cmp)
+{
+	if (!v || !cmp)
+		return -1;
+
+	size_t lo = 0, hi = v->len;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		int c = cmp(key, sda_view_elt(v, mid));
+		if (c == 0)
+			return (ptrdiff_t)mid;
+		if (c < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return -1;
+}
+
+ptrdiff_t
+sda_view_find(const sda_view_t *v, const void *key, sda_compare_callback cmp)
+{
+	if (!v || !cmp)
+		return -1;
+
+	for (size_t i = 0; i < v->len; i++)
+	{
+		if (cmp(key, sda_view_elt(v, i)) == 0)
+			return (ptrdiff_t)i;
+	}
+
+	return -1;
+}
+
+int
+sda_sort(sda_t *a, sda_compare_callback cmp)
+{
+	const sda_t_real *array = (const sda_t_real *)a;
+	if (!array || (array->map_flags & SDA_MAP_RDONLY))
+		return -1;
+
+	sda_view_t v = sda_view(a);
+	return sda_view_sort(&v, cmp);
+}
+
+ptrdiff_t
+sda_bsearch(const sda_t *a, const void *key, sda_compare_callback cmp)
+{
+	sda_view_t v = sda_view(a);
+	return sda_view_bsearch(&v, key, cmp);
+}
+
 void
 sda_set_clear_func(sda_t *a, sda_clear_callback func)
 {
@@ -222,12 +679,41 @@ sda_set_clear_func(sda_t *a, sda_clear_callback func)
 	array->clear_func = func;
 }
 
+/* Slide the surviving elements [start, end) down to the write position.
+ * Runs between removed elements are moved with one memmove each. */
+static void
+sda_keep_run(sda_t_real *array, size_t *w, size_t start, size_t end)
+{
+	if (end <= start)
+		return;
+
+	if (*w != start)
+	{
+		memmove(sda_elt_pos(array, *w),
+			sda_elt_pos(array, start),
+			sda_elt_len(array, end - start));
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_MOVE_BYTES, sda_elt_len(array, end - start));
+	}
+	*w += end - start;
+}
+
 static void
+sda_compact_finish(sda_t_real *array, size_t w)
+{
+	if (w < array->len)
+		sda_elt_zero(array, w, array->len - w);
+	array->len = w;
+}
+
+static bool
 sda_maybe_expand(sda_t_real *array, size_t len)
 {
 	size_t max_len, want_len;
 	max_len = SDA_MIN(SIZE_MAX / 2 / array->elt_size, UINT_MAX);
 
+	if (array->map_flags & SDA_MAP_RDONLY)
+		return false;
+
 	/* Detect potential overflow */
 	if ((max_len - array->len) < len)
 		abort();
@@ -240,7 +726,37 @@ sda_maybe_expand(sda_t_real *array, size_t len)
 		assert(want_alloc >= sda_elt_len(array, want_len));
 		want_alloc = SDA_MAX(want_alloc, 16);
 
-		array->data = realloc(array->data, want_alloc);
+		NOSHIRO_STAT_INC(NOSHIRO_STAT_REALLOCS);
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_REALLOC_BYTES, want_alloc);
+		if (array->map_flags & SDA_MAP_MAPPED)
+			return sda_map_expand(array, want_alloc);
+
+		char *data;
+		if (array->alignment != 0)
+		{
+			/* No aligned realloc: allocate and copy by hand */
+			want_alloc = SDA_MAX(want_alloc, array->alignment);
+			if (posix_memalign((void **)&data,
+					   array->alignment,
+					   want_alloc) != 0)
+				return false;
+			if (array->data != NULL)
+			{
+				memcpy(data,
+				       array->data,
+				       sda_elt_len(array, array->elt_capacity));
+				NOSHIRO_STAT_ADD(NOSHIRO_STAT_COPY_BYTES,
+						 sda_elt_len(array, array->elt_capacity));
+				free(array->data);
+			}
+		}
+		else
+		{
+			data = realloc(array->data, want_alloc);
+			if (data == NULL)
+				return false;
+		}
+		array->data = data;
 
 		memset(sda_elt_pos(array, array->elt_capacity),
 		       0,
@@ -249,6 +765,42 @@ sda_maybe_expand(sda_t_real *array, size_t len)
 		array->elt_capacity =
 		    SDA_MIN(want_alloc / array->elt_size, UINT_MAX);
 	}
+
+	return true;
+}
+
+/* Grow the backing file and its mapping. The new tail of the file reads
+ * as zeros after ftruncate, so it is not cleared by hand. */
+static bool
+sda_map_expand(sda_t_real *array, size_t want_alloc)
+{
+	size_t map_size = SDA_MAP_HEADER_SIZE + want_alloc;
+	char *map;
+
+	if (ftruncate(array->fd, (off_t)map_size) != 0)
+		return false;
+
+#if defined(__linux__)
+	map = mremap(array->map, array->map_size, map_size, MREMAP_MAYMOVE);
+#else
+	map = mmap(NULL,
+		   map_size,
+		   PROT_READ | PROT_WRITE,
+		   MAP_SHARED,
+		   array->fd,
+		   0);
+	if (map != MAP_FAILED)
+		munmap(array->map, array->map_size);
+#endif
+	if (map == MAP_FAILED)
+		return false;
+
+	array->map = map;
+	array->map_size = map_size;
+	array->data = map + SDA_MAP_HEADER_SIZE;
+	array->elt_capacity = SDA_MIN(want_alloc / array->elt_size, UINT_MAX);
+	sda_map_hdr(array)->capacity = array->elt_capacity;
+	return true;
 }
 
 size_t
@@ -26,7 +26,11 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "bitset.h"
+
 typedef void (*sda_clear_callback)(void *);
+typedef bool (*sda_predicate_callback)(const void *elt, void *ctx);
+typedef int (*sda_compare_callback)(const void *, const void *);
 
 typedef struct {
 	char *data;
@@ -34,6 +38,12 @@ typedef struct {
 } sda_t;
 
 sda_t *sda_new(size_t element_size);
+/**
+ * Like sda_new(), but the data pointer is always a multiple of
+ * @p alignment (a power of two), e.g. 32 or 64 for SIMD loads. The
+ * segment returned by sda_free() can still be released with free().
+ */
+sda_t *sda_new_aligned(size_t element_size, size_t alignment);
 char *sda_free(sda_t *sda, bool free_segment);
 sda_t *sda_append_vals(sda_t *a, void *data, size_t len);
 sda_t *sda_prepend_vals(sda_t *a, void *data, size_t len);
@@ -42,6 +52,148 @@ sda_t *sda_set_size(sda_t *a, size_t length);
 sda_t *sda_remove_range(sda_t *a, size_t index_, size_t length);
 void sda_set_clear_func(sda_t *a, sda_clear_callback func);
 
+/*
+ * Bulk removal. Each call compacts the array in a single linear pass,
+ * moving every run of surviving elements once, and calls the clear function
+ * only on the elements that are removed. The order of the remaining elements
+ * is preserved.
+ */
+
+/**
+ * Remove every element for which @p pred returns true.
+ */
+sda_t *sda_remove_if(sda_t *a, sda_predicate_callback pred, void *ctx);
+
+/**
+ * Remove the elements at @p indices, which must be sorted in ascending
+ * order (duplicates are allowed). Returns NULL without touching the array
+ * if an index is out of range or the list is not sorted.
+ */
+sda_t *sda_remove_indices(sda_t *a, const size_t *indices, size_t count);
+
+/**
+ * Remove element i for every bit i set in @p mask. Elements past the end
+ * of the mask are kept.
+ */
+sda_t *sda_remove_mask(sda_t *a, const bitset_t *mask);
+
+/*
+ * File-backed arrays.
+ *
+ * The elements live in a shared mapping of a file that starts with a small
+ * header (element size, length, capacity, version), so an array can be
+ * reopened by a later process, or by several processes at once, without
+ * parsing or copying. Growth extends the file and remaps it, which moves
+ * the data pointer just like realloc does for heap arrays. The stored
+ * length is written back by sda_map_sync() and sda_free(); sda_free()
+ * unmaps and closes the file, never calls the clear function and always
+ * returns NULL for these arrays.
+ */
+
+/**
+ * Create (or truncate) @p path and map it as an empty array.
+ */
+sda_t *sda_map_new(const char *path, size_t element_size);
+
+/**
+ * Map an array previously written by sda_map_new(). A read-only array
+ * shares the file pages directly; every modifying call on it fails.
+ */
+sda_t *sda_map_open(const char *path, bool read_only);
+
+/**
+ * Store the length in the header and msync the mapping to disk.
+ *
+ * @return 0 on success, -1 on error
+ */
+int sda_map_sync(sda_t *a);
+
+/*
+ * Views.
+ *
+ * A view describes elements of an existing array without owning or copying
+ * them: element i is at data + i * stride and is elt_size bytes long. Views
+ * select a sub-range, every k-th element, or a single field of a struct
+ * element. A view stays valid until the array it was taken from is resized
+ * or freed.
+ */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t stride;
+	size_t elt_size;
+	bool read_only; /* taken from a read-only mapping */
+} sda_view_t;
+
+/**
+ * View of the whole array.
+ */
+sda_view_t sda_view(const sda_t *a);
+
+/**
+ * View of @p len elements starting at @p start, taking every @p step-th
+ * one. The length is clamped to the array; a bad start or step gives an
+ * empty view.
+ */
+sda_view_t sda_view_range(const sda_t *a, size_t start, size_t len, size_t step);
+
+/**
+ * View of the @p size bytes at @p offset inside every element, e.g. one
+ * coordinate of an array of points.
+ */
+sda_view_t sda_view_field(const sda_t *a, size_t offset, size_t size);
+
+/**
+ * Sub-view of a view, with the same rules as sda_view_range().
+ */
+sda_view_t sda_view_slice(const sda_view_t *v, size_t start, size_t len, size_t step);
+
+/**
+ * Copy the viewed elements, packed, to @p out (v->len * v->elt_size
+ * bytes).
+ */
+void sda_view_copy(const sda_view_t *v, void *out);
+
+/**
+ * Copy the viewed elements into a new array.
+ */
+sda_t *sda_view_to_sda(const sda_view_t *v);
+
+/**
+ * Sort the viewed elements in place. Strided views are gathered into a
+ * temporary buffer, sorted and scattered back.
+ *
+ * @return 0 on success, -1 if the view is of a read-only mapping or the
+ *         temporary buffer could not be allocated
+ */
+int sda_view_sort(const sda_view_t *v, sda_compare_callback cmp);
+
+/**
+ * Binary search of a view sorted by @p cmp, straight on the strided data.
+ *
+ * @return index of a matching element, or -1
+ */
+ptrdiff_t sda_view_bsearch(const sda_view_t *v,
+			   const void *key,
+			   sda_compare_callback cmp);
+
+/**
+ * Linear search for the first element equal to @p key under @p cmp.
+ *
+ * @return index of the element, or -1
+ */
+ptrdiff_t sda_view_find(const sda_view_t *v,
+			const void *key,
+			sda_compare_callback cmp);
+
+/* Whole-array shortcuts for the view algorithms */
+int sda_sort(sda_t *a, sda_compare_callback cmp);
+ptrdiff_t sda_bsearch(const sda_t *a, const void *key, sda_compare_callback cmp);
+
+#define sda_view_elt(v, i)      ((void *)((v)->data + (size_t)(i) * (v)->stride))
+#define sda_view_index(v, t, i) (*(t *)sda_view_elt((v), (i)))
+#define sda_view_foreach(v, i)  for (size_t i = 0; i < (v)->len; i++)
+
 #define sda_index(a, t, i)      (((t *)(void *)(a)->data)[(i)])
 #define sda_append_val(a, v)    sda_append_vals(a, &(v), 1)
 #define sda_prepend_val(a, v)   sda_prepend_vals(a, &(v), 1)
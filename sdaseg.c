@@ -0,0 +1,241 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sdaseg.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SDA_SEG_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Default chunk size in bytes when the caller does not pick one */
+#define SDA_SEG_DEFAULT_CHUNK (64 * 1024)
+
+typedef struct {
+	char **chunks;
+	size_t len;
+	size_t elt_size;
+	size_t chunk_shift;
+	size_t chunk_count;  /* number of allocated chunks */
+	size_t dir_capacity; /* number of slots in chunks */
+	sda_clear_callback clear_func;
+} sda_seg_t_real;
+
+#define sda_seg_chunk_bytes(array) \
+	((array)->elt_size << (array)->chunk_shift)
+
+static bool sda_seg_reserve(sda_seg_t_real *array, size_t want_len);
+
+sda_seg_t *
+sda_seg_new(size_t element_size, size_t chunk_len)
+{
+	if (element_size == 0)
+		return NULL;
+
+	size_t shift = 0;
+	if (chunk_len == 0)
+	{
+		/* Largest power of two that keeps a chunk within the default */
+		while ((element_size << (shift + 1)) <= SDA_SEG_DEFAULT_CHUNK)
+			shift++;
+	}
+	else
+	{
+		while (((size_t)1 << shift) < chunk_len)
+		{
+			if (shift + 1 >= sizeof(size_t) * 8)
+				return NULL;
+			shift++;
+		}
+	}
+	if (SIZE_MAX / element_size < ((size_t)1 << shift))
+		return NULL;
+
+	sda_seg_t_real *array = (sda_seg_t_real *)malloc(sizeof(sda_seg_t_real));
+	if (!array)
+		return NULL;
+
+	array->chunks = NULL;
+	array->len = 0;
+	array->elt_size = element_size;
+	array->chunk_shift = shift;
+	array->chunk_count = 0;
+	array->dir_capacity = 0;
+	array->clear_func = NULL;
+	return (sda_seg_t *)array;
+}
+
+void
+sda_seg_free(sda_seg_t *a)
+{
+	sda_seg_t_real *array = (sda_seg_t_real *)a;
+	if (!array)
+		return;
+
+	if (array->clear_func != NULL)
+	{
+		for (size_t i = 0; i < array->len; i++)
+			array->clear_func(sda_seg_elt(array, i));
+	}
+
+	for (size_t i = 0; i < array->chunk_count; i++)
+		free(array->chunks[i]);
+	free(array->chunks);
+	free(array);
+}
+
+sda_seg_t *
+sda_seg_append_vals(sda_seg_t *a, const void *data, size_t len)
+{
+	sda_seg_t_real *array = (sda_seg_t_real *)a;
+	if (!array)
+		return NULL;
+
+	if (len == 0)
+		return a;
+
+	if (SIZE_MAX - array->len < len || !sda_seg_reserve(array, array->len + len))
+		return NULL;
+
+	const char *src = (const char *)data;
+	size_t mask = sda_seg_chunk_len(array) - 1;
+	while (len > 0)
+	{
+		size_t offset = array->len & mask;
+		size_t n = SDA_SEG_MIN(len, mask + 1 - offset);
+
+		memcpy(sda_seg_elt(array, array->len), src, n * array->elt_size);
+
+		src += n * array->elt_size;
+		array->len += n;
+		len -= n;
+	}
+
+	return a;
+}
+
+sda_seg_t *
+sda_seg_set_size(sda_seg_t *a, size_t length)
+{
+	sda_seg_t_real *array = (sda_seg_t_real *)a;
+	if (!array)
+		return NULL;
+
+	size_t mask = sda_seg_chunk_len(array) - 1;
+	if (length > array->len)
+	{
+		if (!sda_seg_reserve(array, length))
+			return NULL;
+
+		/* Chunks are recycled on shrink, so the new tail must be zeroed */
+		size_t i = array->len;
+		while (i < length)
+		{
+			size_t n = SDA_SEG_MIN(length - i, mask + 1 - (i & mask));
+			memset(sda_seg_elt(array, i), 0, n * array->elt_size);
+			i += n;
+		}
+	}
+	else if (array->clear_func != NULL)
+	{
+		for (size_t i = length; i < array->len; i++)
+			array->clear_func(sda_seg_elt(array, i));
+	}
+
+	array->len = length;
+	return a;
+}
+
+void
+sda_seg_set_clear_func(sda_seg_t *a, sda_clear_callback func)
+{
+	sda_seg_t_real *array = (sda_seg_t_real *)a;
+	if (array == NULL)
+		return;
+
+	array->clear_func = func;
+}
+
+size_t
+sda_seg_chunk_count(const sda_seg_t *a)
+{
+	if (a == NULL || a->len == 0)
+		return 0;
+
+	return ((a->len - 1) >> a->chunk_shift) + 1;
+}
+
+size_t
+sda_seg_chunk(const sda_seg_t *a, size_t chunk, void **data)
+{
+	if (chunk >= sda_seg_chunk_count(a))
+	{
+		*data = NULL;
+		return 0;
+	}
+
+	*data = a->chunks[chunk];
+
+	size_t first = chunk << a->chunk_shift;
+	return SDA_SEG_MIN(a->len - first, sda_seg_chunk_len(a));
+}
+
+/* Make sure chunks exist for the first want_len elements. Only the
+ * directory is ever reallocated; chunks themselves never move. */
+static bool
+sda_seg_reserve(sda_seg_t_real *array, size_t want_len)
+{
+	size_t want_chunks = ((want_len - 1) >> array->chunk_shift) + 1;
+	if (want_len == 0 || want_chunks <= array->chunk_count)
+		return true;
+
+	if (want_chunks > array->dir_capacity)
+	{
+		size_t cap = array->dir_capacity ? array->dir_capacity : 8;
+		while (cap < want_chunks)
+		{
+			if (cap > SIZE_MAX / 2 / sizeof(char *))
+				return false;
+			cap <<= 1;
+		}
+
+		char **dir = (char **)realloc(array->chunks, cap * sizeof(char *));
+		if (dir == NULL)
+			return false;
+
+		array->chunks = dir;
+		array->dir_capacity = cap;
+	}
+
+	while (array->chunk_count < want_chunks)
+	{
+		char *chunk = (char *)malloc(sda_seg_chunk_bytes(array));
+		if (chunk == NULL)
+			return false;
+
+		array->chunks[array->chunk_count++] = chunk;
+	}
+
+	return true;
+}
+
+#undef SDA_SEG_MIN
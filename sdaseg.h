@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_SDASEG_H__
+#define __NOSHIRO_SDASEG_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sda.h"
+
+/*
+ * Segmented dynamic array.
+ *
+ * Elements live in fixed-size chunks of a power-of-two number of elements,
+ * reached through a directory of chunk pointers. Growing the array only
+ * allocates new chunks (and occasionally grows the directory, which holds
+ * pointers only), so elements are never relocated and pointers to them stay
+ * valid until the element is removed or the array is freed.
+ */
+typedef struct {
+	char **chunks;
+	size_t len;
+	size_t elt_size;
+	size_t chunk_shift;
+} sda_seg_t;
+
+/**
+ * Create a new segmented array.
+ *
+ * @param element_size size of one element in bytes
+ * @param chunk_len    number of elements per chunk, rounded up to a power of
+ *                     two; 0 picks a chunk of about 64KB
+ * @return             the new array, or NULL on failure
+ */
+sda_seg_t *sda_seg_new(size_t element_size, size_t chunk_len);
+
+/**
+ * Free a segmented array, calling the clear function on every element.
+ */
+void sda_seg_free(sda_seg_t *a);
+
+/**
+ * Append @p len elements copied from @p data. Existing elements keep their
+ * addresses.
+ *
+ * @return @p a, or NULL if a chunk could not be allocated
+ */
+sda_seg_t *sda_seg_append_vals(sda_seg_t *a, const void *data, size_t len);
+
+/**
+ * Grow (zero-filling) or shrink (clearing) the array to @p length elements.
+ * Chunks are kept when shrinking and reused by later appends.
+ */
+sda_seg_t *sda_seg_set_size(sda_seg_t *a, size_t length);
+
+void sda_seg_set_clear_func(sda_seg_t *a, sda_clear_callback func);
+
+/**
+ * Number of chunks currently holding elements.
+ */
+size_t sda_seg_chunk_count(const sda_seg_t *a);
+
+/**
+ * Get the contiguous storage of chunk @p chunk.
+ *
+ * Loops over the returned block have unit stride and no aliasing with the
+ * directory, so they vectorize like loops over a plain array.
+ *
+ * @param[in]  a     segmented array
+ * @param[in]  chunk chunk number, less than sda_seg_chunk_count()
+ * @param[out] data  first element of the chunk
+ * @return           number of elements in the chunk
+ */
+size_t sda_seg_chunk(const sda_seg_t *a, size_t chunk, void **data);
+
+#define sda_seg_chunk_len(a)  ((size_t)1 << (a)->chunk_shift)
+#define sda_seg_elt(a, i) \
+	((void *)((a)->chunks[(i) >> (a)->chunk_shift] + \
+		  ((i) & (sda_seg_chunk_len(a) - 1)) * (a)->elt_size))
+#define sda_seg_index(a, t, i)  (*(t *)sda_seg_elt((a), (i)))
+#define sda_seg_append_val(a, v) sda_seg_append_vals(a, &(v), 1)
+
+#endif /* __NOSHIRO_SDASEG_H__ */
@@ -21,6 +21,8 @@
  */
 
 #include "sds.h"
+#include "stats.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -42,6 +44,14 @@ static sds_t *sds_slice_recursive(char *s,
 				  sds_t *save);
 static inline sds_t *sds_assign(char *s, size_t len);
 
+/* malloc(), counted in the library stats */
+static inline void *
+sds_malloc(size_t size)
+{
+	NOSHIRO_STAT_ALLOC(size);
+	return malloc(size);
+}
+
 sds_t *
 sds_set(sds_t *str, char *s)
 {
@@ -87,7 +97,7 @@ sds_free(sds_t *s)
 sds_t *
 sds_new(const char *s)
 {
-	sds_t *str = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *str = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (str == NULL)
 		return NULL;
 	if (s == NULL)
@@ -99,7 +109,7 @@ sds_new(const char *s)
 		return str;
 	}
 	size_t len = strlen(s);
-	if ((str->data = (uint8_t *)malloc(len + 1)) == NULL)
+	if ((str->data = (uint8_t *)sds_malloc(len + 1)) == NULL)
 	{
 		free(str);
 		return NULL;
@@ -115,7 +125,7 @@ sds_new(const char *s)
 sds_t *
 sds_buf_new(unsigned char *buf, uint64_t len)
 {
-	sds_t *str = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *str = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (str == NULL)
 		return NULL;
 
@@ -129,16 +139,19 @@ sds_buf_new(unsigned char *buf, uint64_t len)
 sds_t *
 sds_dup(sds_t *str)
 {
-	sds_t *s = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *s = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (s == NULL)
 		return NULL;
-	if ((s->data = (uint8_t *)malloc(str->len + 1)) == NULL)
+	if ((s->data = (uint8_t *)sds_malloc(str->len + 1)) == NULL)
 	{
 		free(s);
 		return NULL;
 	}
 	if (str->data != NULL)
+	{
 		memcpy(s->data, str->data, str->len);
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_COPY_BYTES, str->len);
+	}
 	s->data[str->len] = 0;
 	s->len = str->len;
 	s->data_ref = 0;
@@ -151,10 +164,10 @@ sds_alloc(size_t size)
 {
 	if (size < 0)
 		return NULL;
-	sds_t *s = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *s = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (s == NULL)
 		return NULL;
-	if ((s->data = (uint8_t *)malloc(size + 1)) == NULL)
+	if ((s->data = (uint8_t *)sds_malloc(size + 1)) == NULL)
 	{
 		free(s);
 		return NULL;
@@ -170,15 +183,16 @@ sds_const_ndup(char *str, size_t size)
 {
 	if (size < 0)
 		return NULL;
-	sds_t *s = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *s = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (s == NULL)
 		return NULL;
-	if ((s->data = (uint8_t *)malloc(size + 1)) == NULL)
+	if ((s->data = (uint8_t *)sds_malloc(size + 1)) == NULL)
 	{
 		free(s);
 		return NULL;
 	}
 	memcpy(s->data, str, size);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_COPY_BYTES, size);
 	s->data[size] = 0;
 	s->len = size;
 	s->data_ref = 0;
@@ -189,7 +203,7 @@ sds_const_ndup(char *str, size_t size)
 sds_t *
 sds_ref_dup(sds_t *str)
 {
-	sds_t *s = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *s = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (s == NULL)
 		return NULL;
 	s->data = str->data;
@@ -205,7 +219,7 @@ sds_const_ref_dup(char *s)
 	if (s == NULL)
 		return NULL;
 
-	sds_t *str = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *str = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (str == NULL)
 		return NULL;
 
@@ -219,7 +233,7 @@ sds_const_ref_dup(char *s)
 sds_t *
 sds_concat(sds_t *s1, sds_t *s2, sds_t *sep)
 {
-	sds_t *str = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *str = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (str == NULL)
 		return NULL;
 
@@ -235,7 +249,7 @@ sds_concat(sds_t *s1, sds_t *s2, sds_t *sep)
 	if (s2 != NULL)
 		size += s2->len;
 
-	if ((p = str->data = (uint8_t *)malloc(size + 1)) == NULL)
+	if ((p = str->data = (uint8_t *)sds_malloc(size + 1)) == NULL)
 	{
 		free(str);
 		return NULL;
@@ -428,6 +442,7 @@ sds_strstr(sds_t *text, sds_t *pattern)
 {
 	if (text == pattern || text->data == pattern->data)
 		return (char *)(text->data);
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_SEARCHES);
 	return strstr((char *)(text->data), (char *)(pattern->data));
 }
 
@@ -436,6 +451,7 @@ sds_const_strstr(sds_t *text, char *pattern)
 {
 	if (text->data == (uint8_t *)pattern)
 		return (char *)(text->data);
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_SEARCHES);
 	return strstr((char *)(text->data), pattern);
 }
 
@@ -462,10 +478,14 @@ sds_kmp(sds_t *text, sds_t *pattern)
 {
 	if (text == pattern || text->data == pattern->data)
 		return (char *)(text->data);
-	return kmp_string_match((char *)(text->data),
-				(char *)(pattern->data),
-				text->len,
-				pattern->len);
+
+	TRACE_BEGIN_N(span, "sds_kmp", text->len);
+	char *match = kmp_string_match((char *)(text->data),
+				       (char *)(pattern->data),
+				       text->len,
+				       pattern->len);
+	TRACE_END(span);
+	return match;
 }
 
 char *
@@ -473,8 +493,12 @@ sds_const_kmp(sds_t *text, char *pattern)
 {
 	if (text->data == (uint8_t *)pattern)
 		return (char *)(text->data);
-	return kmp_string_match(
+
+	TRACE_BEGIN_N(span, "sds_const_kmp", text->len);
+	char *match = kmp_string_match(
 	    (char *)(text->data), pattern, text->len, strlen(pattern));
+	TRACE_END(span);
+	return match;
 }
 
 sds_t *
@@ -509,8 +533,12 @@ sds_slice(sds_t *s, const char *sep_array)
 	{
 		ascii[(uint8_t)(*ps)] = 1;
 	}
-	return sds_slice_recursive(
+
+	TRACE_BEGIN_N(span, "sds_slice", tmp->len);
+	sds_t *array = sds_slice_recursive(
 	    (char *)(tmp->data), tmp->len, ascii, 1, tmp);
+	TRACE_END(span);
+	return array;
 }
 
 void
@@ -526,7 +554,7 @@ sds_slice_free(sds_t *array)
 sds_t *
 sds_strcat(sds_t *s1, sds_t *s2)
 {
-	sds_t *ret = (sds_t *)malloc(sizeof(sds_t));
+	sds_t *ret = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (ret == NULL)
 		return NULL;
 	uint64_t len = s1->len + s2->len;
@@ -538,7 +566,7 @@ sds_strcat(sds_t *s1, sds_t *s2)
 		ret->ref = 1;
 		return ret;
 	}
-	if ((ret->data = (uint8_t *)malloc(len + 1)) == NULL)
+	if ((ret->data = (uint8_t *)sds_malloc(len + 1)) == NULL)
 	{
 		free(ret);
 		return NULL;
@@ -621,7 +649,7 @@ sds_lower(sds_t *s)
 static inline int *
 compute_prefix_function(const char *pattern, size_t m)
 {
-	int *shift = (int *)malloc(sizeof(int) * m);
+	int *shift = (int *)sds_malloc(sizeof(int) * m);
 	if (shift == NULL)
 		return NULL;
 	shift[0] = 0;
@@ -643,6 +671,7 @@ kmp_string_match(char *text,
 		 size_t text_len,
 		 size_t pattern_len)
 {
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_SEARCHES);
 	int *shift = compute_prefix_function(pattern, pattern_len);
 	if (shift == NULL)
 		return NULL;
@@ -679,7 +708,7 @@ sds_slice_recursive(char *s, uint64_t len, uint8_t *ascii, int cnt, sds_t *save)
 	}
 	if (jmp_ascii >= end)
 	{
-		sds_t *ret = (sds_t *)malloc(sizeof(sds_t) * cnt);
+		sds_t *ret = (sds_t *)sds_malloc(sizeof(sds_t) * cnt);
 		if (ret == NULL)
 			return NULL;
 		ret[cnt - 1].data = (uint8_t *)save;
@@ -710,7 +739,7 @@ static inline sds_t *
 sds_assign(char *s, size_t len)
 {
 	sds_t *str;
-	str = (sds_t *)malloc(sizeof(sds_t));
+	str = (sds_t *)sds_malloc(sizeof(sds_t));
 	if (str == NULL)
 		return NULL;
 	str->data = (uint8_t *)s;
@@ -23,6 +23,7 @@
 #ifndef __MINGC_GSTRING_H__
 #define __MINGC_GSTRING_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct {
@@ -0,0 +1,481 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "sha.h"
+#include "cpu.h"
+#include "stats.h"
+
+#include <string.h>
+
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static inline uint32_t
+sha_load_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+	       (uint32_t)p[3];
+}
+
+static inline void
+sha_store_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+#define SHA_ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define SHA_ROTR32(v, n) (((v) >> (n)) | ((v) << (32 - (n))))
+
+/* Compresses nblocks consecutive 64-byte blocks into state */
+typedef void (*sha_blocks_fn)(uint32_t *state, const uint8_t *src,
+			      size_t nblocks);
+
+/*
+ * SHA-1 and SHA-256 share the Merkle-Damgard framing: 64-byte blocks,
+ * buffered partial input and a big-endian bit count in the padding.
+ */
+static void
+sha_update(sha_blocks_fn blocks, uint32_t *state, uint64_t *count,
+	   uint8_t *buf, const uint8_t *src, size_t len)
+{
+	size_t used = (size_t)(*count & 63);
+
+	*count += len;
+
+	if (used)
+	{
+		size_t room = 64 - used;
+
+		if (len < room)
+		{
+			memcpy(buf + used, src, len);
+			return;
+		}
+		memcpy(buf + used, src, room);
+		blocks(state, buf, 1);
+		src += room;
+		len -= room;
+	}
+
+	/* Whole blocks are hashed straight from the input */
+	if (len >= 64)
+		blocks(state, src, len / 64);
+	if (len & 63)
+		memcpy(buf, src + (len & ~(size_t)63), len & 63);
+}
+
+static void
+sha_pad(sha_blocks_fn blocks, uint32_t *state, uint64_t count, uint8_t *buf)
+{
+	size_t used = (size_t)(count & 63);
+	uint64_t bits = count << 3;
+
+	/* Pad with 0x80 0* up to 56 mod 64, then the big-endian bit count */
+	buf[used++] = 0x80;
+	if (used > 56)
+	{
+		memset(buf + used, 0, 64 - used);
+		blocks(state, buf, 1);
+		used = 0;
+	}
+	memset(buf + used, 0, 56 - used);
+	sha_store_be32(buf + 56, (uint32_t)(bits >> 32));
+	sha_store_be32(buf + 60, (uint32_t)bits);
+	blocks(state, buf, 1);
+}
+
+/* ------------------------------- SHA-1 ------------------------------- */
+
+/* The message schedule is kept as a 16-word ring rather than 80 words */
+static void
+sha1_blocks_scalar(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+	while (nblocks--)
+	{
+		uint32_t w[16];
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+			 e = state[4];
+
+		for (int i = 0; i < 16; i++)
+			w[i] = sha_load_be32(src + i * 4);
+
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k, t;
+
+			if (i >= 16)
+			{
+				t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^
+				    w[i & 15];
+				w[i & 15] = SHA_ROTL32(t, 1);
+			}
+
+			if (i < 20)
+			{
+				f = d ^ (b & (c ^ d));
+				k = 0x5a827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (d & (b | c));
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			t = SHA_ROTL32(a, 5) + f + e + k + w[i & 15];
+			e = d;
+			d = c;
+			c = SHA_ROTL32(b, 30);
+			b = a;
+			a = t;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		src += 64;
+	}
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+/*
+ * SHA-NI keeps a, b, c, d in one register (a in the top lane) and e in
+ * the top lane of another. sha1rnds4 runs four rounds, sha1nexte derives
+ * the next e and the msg1/xor/msg2 chain extends the schedule four words
+ * at a time; M[g % 4] holds words 4g..4g+3.
+ */
+#define SHA1_NI_ROUNDS(g, f) \
+	do \
+	{ \
+		if ((g) < 4) \
+			M[(g) % 4] = _mm_shuffle_epi8( \
+			    _mm_loadu_si128((const __m128i *)(const void *)(src + (g) * 16)), \
+			    mask); \
+		if ((g) == 0) \
+			E[0] = _mm_add_epi32(E[0], M[0]); \
+		else \
+			E[(g) & 1] = _mm_sha1nexte_epu32(E[(g) & 1], M[(g) % 4]); \
+		E[((g) + 1) & 1] = abcd; \
+		if ((g) >= 3 && (g) <= 18) \
+			M[((g) + 1) % 4] = _mm_sha1msg2_epu32(M[((g) + 1) % 4], M[(g) % 4]); \
+		abcd = _mm_sha1rnds4_epu32(abcd, E[(g) & 1], f); \
+		if ((g) >= 1 && (g) <= 16) \
+			M[((g) + 3) % 4] = _mm_sha1msg1_epu32(M[((g) + 3) % 4], M[(g) % 4]); \
+		if ((g) >= 2 && (g) <= 17) \
+			M[((g) + 2) % 4] = _mm_xor_si128(M[((g) + 2) % 4], M[(g) % 4]); \
+	} while (0)
+
+NOSHIRO_TARGET("sha,sse4.1")
+static void
+sha1_blocks_shani(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+	const __m128i mask =
+	    _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+	__m128i abcd = _mm_shuffle_epi32(
+	    _mm_loadu_si128((const __m128i *)(const void *)state), 0x1b);
+	__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+	while (nblocks--)
+	{
+		__m128i M[4], E[2] = {e0, _mm_setzero_si128()};
+		__m128i abcd_save = abcd;
+
+		_Pragma("GCC unroll 5") for (int g = 0; g < 5; g++)
+			SHA1_NI_ROUNDS(g, 0);
+		_Pragma("GCC unroll 5") for (int g = 5; g < 10; g++)
+			SHA1_NI_ROUNDS(g, 1);
+		_Pragma("GCC unroll 5") for (int g = 10; g < 15; g++)
+			SHA1_NI_ROUNDS(g, 2);
+		_Pragma("GCC unroll 5") for (int g = 15; g < 20; g++)
+			SHA1_NI_ROUNDS(g, 3);
+
+		e0 = _mm_sha1nexte_epu32(E[0], e0);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		src += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)(void *)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#undef SHA1_NI_ROUNDS
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+static void
+sha1_blocks(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("sha") && cpu_supports("sse4.1"))
+	{
+		sha1_blocks_shani(state, src, nblocks);
+		return;
+	}
+#endif
+	sha1_blocks_scalar(state, src, nblocks);
+}
+
+void
+sha1_init(sha1_t *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->state[4] = 0xc3d2e1f0;
+	ctx->count = 0;
+}
+
+void
+sha1_update(sha1_t *ctx, const uint8_t *src, size_t len)
+{
+	sha_update(sha1_blocks, ctx->state, &ctx->count, ctx->buf, src, len);
+}
+
+void
+sha1_final(sha1_t *ctx, uint8_t *dst)
+{
+	sha_pad(sha1_blocks, ctx->state, ctx->count, ctx->buf);
+	for (int i = 0; i < 5; i++)
+		sha_store_be32(dst + i * 4, ctx->state[i]);
+	memset(ctx, 0, sizeof(*ctx)); /* In case it's sensitive */
+}
+
+void
+sha1_sum(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	sha1_t ctx;
+
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_HASHES);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, len);
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, src, len);
+	sha1_final(&ctx, dst);
+}
+
+/* ------------------------------ SHA-256 ------------------------------ */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void
+sha256_blocks_scalar(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+	while (nblocks--)
+	{
+		uint32_t w[16];
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+			 e = state[4], f = state[5], g = state[6], h = state[7];
+
+		for (int i = 0; i < 16; i++)
+			w[i] = sha_load_be32(src + i * 4);
+
+		for (int i = 0; i < 64; i++)
+		{
+			if (i >= 16)
+			{
+				uint32_t w15 = w[(i + 1) & 15], w2 = w[(i + 14) & 15];
+				uint32_t s0 = SHA_ROTR32(w15, 7) ^ SHA_ROTR32(w15, 18) ^ (w15 >> 3);
+				uint32_t s1 = SHA_ROTR32(w2, 17) ^ SHA_ROTR32(w2, 19) ^ (w2 >> 10);
+
+				w[i & 15] += s0 + w[(i + 9) & 15] + s1;
+			}
+
+			uint32_t t1 = h +
+				      (SHA_ROTR32(e, 6) ^ SHA_ROTR32(e, 11) ^
+				       SHA_ROTR32(e, 25)) +
+				      (g ^ (e & (f ^ g))) + sha256_k[i] + w[i & 15];
+			uint32_t t2 =
+			    (SHA_ROTR32(a, 2) ^ SHA_ROTR32(a, 13) ^ SHA_ROTR32(a, 22)) +
+			    ((a & b) | (c & (a | b)));
+
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+		src += 64;
+	}
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+/*
+ * SHA-NI works on the state as (a, b, e, f) and (c, d, g, h); every
+ * sha256rnds2 runs two rounds. M[g % 4] holds schedule words 4g..4g+3,
+ * extended with msg1, an alignr for the w[i - 7] term and msg2.
+ */
+#define SHA256_NI_ROUNDS(g) \
+	do \
+	{ \
+		__m128i msg; \
+		if ((g) < 4) \
+			M[(g) % 4] = _mm_shuffle_epi8( \
+			    _mm_loadu_si128((const __m128i *)(const void *)(src + (g) * 16)), \
+			    mask); \
+		msg = _mm_add_epi32( \
+		    M[(g) % 4], \
+		    _mm_loadu_si128((const __m128i *)(const void *)(sha256_k + (g) * 4))); \
+		cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg); \
+		if ((g) >= 3 && (g) <= 14) \
+		{ \
+			__m128i t = _mm_alignr_epi8(M[(g) % 4], M[((g) + 3) % 4], 4); \
+			M[((g) + 1) % 4] = _mm_sha256msg2_epu32( \
+			    _mm_add_epi32(M[((g) + 1) % 4], t), M[(g) % 4]); \
+		} \
+		abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0e)); \
+		if ((g) >= 1 && (g) <= 12) \
+			M[((g) + 3) % 4] = _mm_sha256msg1_epu32(M[((g) + 3) % 4], M[(g) % 4]); \
+	} while (0)
+
+NOSHIRO_TARGET("sha,sse4.1")
+static void
+sha256_blocks_shani(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+	const __m128i mask =
+	    _mm_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+	__m128i dcba = _mm_loadu_si128((const __m128i *)(const void *)state);
+	__m128i hgfe = _mm_loadu_si128((const __m128i *)(const void *)(state + 4));
+	__m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+	__m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+	__m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+	__m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+	while (nblocks--)
+	{
+		__m128i M[4];
+		__m128i abef_save = abef, cdgh_save = cdgh;
+
+		_Pragma("GCC unroll 16") for (int g = 0; g < 16; g++)
+			SHA256_NI_ROUNDS(g);
+
+		abef = _mm_add_epi32(abef, abef_save);
+		cdgh = _mm_add_epi32(cdgh, cdgh_save);
+		src += 64;
+	}
+
+	__m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+	__m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i *)(void *)state, _mm_blend_epi16(feba, dchg, 0xf0));
+	_mm_storeu_si128((__m128i *)(void *)(state + 4),
+			 _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#undef SHA256_NI_ROUNDS
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+static void
+sha256_blocks(uint32_t *state, const uint8_t *src, size_t nblocks)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("sha") && cpu_supports("sse4.1"))
+	{
+		sha256_blocks_shani(state, src, nblocks);
+		return;
+	}
+#endif
+	sha256_blocks_scalar(state, src, nblocks);
+}
+
+void
+sha256_init(sha256_t *ctx)
+{
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->count = 0;
+}
+
+void
+sha256_update(sha256_t *ctx, const uint8_t *src, size_t len)
+{
+	sha_update(sha256_blocks, ctx->state, &ctx->count, ctx->buf, src, len);
+}
+
+void
+sha256_final(sha256_t *ctx, uint8_t *dst)
+{
+	sha_pad(sha256_blocks, ctx->state, ctx->count, ctx->buf);
+	for (int i = 0; i < 8; i++)
+		sha_store_be32(dst + i * 4, ctx->state[i]);
+	memset(ctx, 0, sizeof(*ctx)); /* In case it's sensitive */
+}
+
+void
+sha256_sum(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	sha256_t ctx;
+
+	NOSHIRO_STAT_INC(NOSHIRO_STAT_HASHES);
+	NOSHIRO_STAT_ADD(NOSHIRO_STAT_HASH_BYTES, len);
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, src, len);
+	sha256_final(&ctx, dst);
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_SHA_H__
+#define __NOSHIRO_SHA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_DIGEST_LEN   20 /* size of a SHA-1 digest in bytes */
+#define SHA256_DIGEST_LEN 32 /* size of a SHA-256 digest in bytes */
+
+typedef struct {
+	uint32_t state[5];
+	uint64_t count; /* bytes hashed so far */
+	uint8_t buf[64];
+} sha1_t;
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t count; /* bytes hashed so far */
+	uint8_t buf[64];
+} sha256_t;
+
+/**
+ * Initialize SHA-1 hashing.
+ *
+ * @param ctx hash function context
+ */
+void sha1_init(sha1_t *ctx);
+
+/**
+ * Update hash value.
+ *
+ * @param ctx hash function context
+ * @param src input data to update hash with
+ * @param len input data length
+ */
+void sha1_update(sha1_t *ctx, const uint8_t *src, size_t len);
+
+/**
+ * Finish hashing and output digest value.
+ *
+ * @param ctx hash function context
+ * @param dst buffer of SHA1_DIGEST_LEN bytes where the digest is stored
+ */
+void sha1_final(sha1_t *ctx, uint8_t *dst);
+
+/**
+ * Hash an array of data.
+ *
+ * @param dst The output buffer of SHA1_DIGEST_LEN bytes
+ * @param src The data to hash
+ * @param len The length of the data, in bytes
+ */
+void sha1_sum(uint8_t *dst, const uint8_t *src, size_t len);
+
+/**
+ * Initialize SHA-256 hashing.
+ *
+ * @param ctx hash function context
+ */
+void sha256_init(sha256_t *ctx);
+
+/**
+ * Update hash value.
+ *
+ * @param ctx hash function context
+ * @param src input data to update hash with
+ * @param len input data length
+ */
+void sha256_update(sha256_t *ctx, const uint8_t *src, size_t len);
+
+/**
+ * Finish hashing and output digest value.
+ *
+ * @param ctx hash function context
+ * @param dst buffer of SHA256_DIGEST_LEN bytes where the digest is stored
+ */
+void sha256_final(sha256_t *ctx, uint8_t *dst);
+
+/**
+ * Hash an array of data.
+ *
+ * @param dst The output buffer of SHA256_DIGEST_LEN bytes
+ * @param src The data to hash
+ * @param len The length of the data, in bytes
+ */
+void sha256_sum(uint8_t *dst, const uint8_t *src, size_t len);
+
+#endif /* __NOSHIRO_SHA_H__ */
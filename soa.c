@@ -0,0 +1,394 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "soa.h"
+#include "cpu.h"
+#include "trace.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+typedef struct {
+	size_t len;
+	size_t ncols;
+	sda_t **cols;
+	size_t *col_sizes;
+} soa_t_real;
+
+static void soa_copy_field(char *dst,
+			   size_t dst_stride,
+			   const char *src,
+			   size_t src_stride,
+			   size_t size,
+			   size_t count);
+
+soa_t *
+soa_new(size_t ncols, const size_t *col_sizes, size_t alignment)
+{
+	if (ncols == 0 || col_sizes == NULL)
+		return NULL;
+
+	if (alignment == 0)
+		alignment = 64;
+
+	soa_t_real *s = (soa_t_real *)calloc(1, sizeof(soa_t_real));
+	if (s == NULL)
+		return NULL;
+
+	s->ncols = ncols;
+	s->cols = (sda_t **)calloc(ncols, sizeof(sda_t *));
+	s->col_sizes = (size_t *)malloc(ncols * sizeof(size_t));
+	if (s->cols == NULL || s->col_sizes == NULL)
+		goto fail;
+
+	for (size_t c = 0; c < ncols; c++)
+	{
+		s->cols[c] = sda_new_aligned(col_sizes[c], alignment);
+		if (s->cols[c] == NULL)
+			goto fail;
+		s->col_sizes[c] = col_sizes[c];
+	}
+
+	return (soa_t *)s;
+
+fail:
+	soa_free((soa_t *)s);
+	return NULL;
+}
+
+void
+soa_free(soa_t *s)
+{
+	soa_t_real *soa = (soa_t_real *)s;
+	if (soa == NULL)
+		return;
+
+	if (soa->cols != NULL)
+	{
+		for (size_t c = 0; c < soa->ncols; c++)
+			sda_free(soa->cols[c], true);
+	}
+
+	free(soa->cols);
+	free(soa->col_sizes);
+	free(soa);
+}
+
+soa_t *
+soa_set_size(soa_t *s, size_t length)
+{
+	if (s == NULL)
+		return NULL;
+
+	for (size_t c = 0; c < s->ncols; c++)
+	{
+		if (sda_set_size(s->cols[c], length) == NULL)
+		{
+			/* Keep the columns in step */
+			for (size_t k = 0; k < c; k++)
+				sda_set_size(s->cols[k], s->len);
+			return NULL;
+		}
+	}
+
+	s->len = length;
+	return s;
+}
+
+soa_t *
+soa_append_aos(soa_t *s,
+	       const void *records,
+	       size_t count,
+	       size_t stride,
+	       const size_t *offsets)
+{
+	soa_t_real *soa = (soa_t_real *)s;
+	if (soa == NULL || (count > 0 && records == NULL))
+		return NULL;
+
+	size_t start = soa->len;
+	if (soa_set_size(s, start + count) == NULL)
+		return NULL;
+
+	TRACE_BEGIN_N(span, "soa_append_aos", count);
+	/* One column at a time, so each destination is written sequentially */
+	size_t offset = 0;
+	for (size_t c = 0; c < soa->ncols; c++)
+	{
+		size_t size = soa->col_sizes[c];
+		size_t field = offsets ? offsets[c] : offset;
+
+		soa_copy_field(soa->cols[c]->data + start * size,
+			       size,
+			       (const char *)records + field,
+			       stride,
+			       size,
+			       count);
+		offset += size;
+	}
+
+	TRACE_END(span);
+	return s;
+}
+
+void
+soa_to_aos(const soa_t *s,
+	   size_t start,
+	   size_t count,
+	   void *records,
+	   size_t stride,
+	   const size_t *offsets)
+{
+	const soa_t_real *soa = (const soa_t_real *)s;
+	if (soa == NULL || records == NULL || start >= soa->len)
+		return;
+
+	if (count > soa->len - start)
+		count = soa->len - start;
+
+	TRACE_BEGIN_N(span, "soa_to_aos", count);
+	size_t offset = 0;
+	for (size_t c = 0; c < soa->ncols; c++)
+	{
+		size_t size = soa->col_sizes[c];
+		size_t field = offsets ? offsets[c] : offset;
+
+		soa_copy_field((char *)records + field,
+			       stride,
+			       soa->cols[c]->data + start * size,
+			       size,
+			       size,
+			       count);
+		offset += size;
+	}
+	TRACE_END(span);
+}
+
+/* Strided copy of one field; the common scalar sizes get fixed-size
+ * copies the compiler turns into plain loads and stores. */
+static void
+soa_copy_field(char *dst,
+	       size_t dst_stride,
+	       const char *src,
+	       size_t src_stride,
+	       size_t size,
+	       size_t count)
+{
+	size_t i;
+
+	switch (size)
+	{
+	case 4:
+		for (i = 0; i < count; i++)
+			memcpy(dst + i * dst_stride, src + i * src_stride, 4);
+		break;
+	case 8:
+		for (i = 0; i < count; i++)
+			memcpy(dst + i * dst_stride, src + i * src_stride, 8);
+		break;
+	default:
+		for (i = 0; i < count; i++)
+			memcpy(dst + i * dst_stride,
+			       src + i * src_stride,
+			       size);
+		break;
+	}
+}
+
+/* ---------------------------- reductions ---------------------------- */
+
+static double
+soa_sum_scalar(const double *p, size_t n)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		s0 += p[i];
+		s1 += p[i + 1];
+		s2 += p[i + 2];
+		s3 += p[i + 3];
+	}
+	for (; i < n; i++)
+		s0 += p[i];
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+static double
+soa_min_scalar(const double *p, size_t n)
+{
+	double m = INFINITY;
+	for (size_t i = 0; i < n; i++)
+		m = p[i] < m ? p[i] : m;
+	return m;
+}
+
+static double
+soa_max_scalar(const double *p, size_t n)
+{
+	double m = -INFINITY;
+	for (size_t i = 0; i < n; i++)
+		m = p[i] > m ? p[i] : m;
+	return m;
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+NOSHIRO_TARGET("avx2")
+static double
+soa_hsum_avx2(__m256d v)
+{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_add_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+/* Four independent accumulators hide the latency of vaddpd */
+NOSHIRO_TARGET("avx2")
+static double
+soa_sum_avx2(const double *p, size_t n)
+{
+	__m256d a0 = _mm256_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16)
+	{
+		a0 = _mm256_add_pd(a0, _mm256_loadu_pd(p + i));
+		a1 = _mm256_add_pd(a1, _mm256_loadu_pd(p + i + 4));
+		a2 = _mm256_add_pd(a2, _mm256_loadu_pd(p + i + 8));
+		a3 = _mm256_add_pd(a3, _mm256_loadu_pd(p + i + 12));
+	}
+	for (; i + 4 <= n; i += 4)
+		a0 = _mm256_add_pd(a0, _mm256_loadu_pd(p + i));
+
+	double sum = soa_hsum_avx2(
+	    _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+	for (; i < n; i++)
+		sum += p[i];
+	return sum;
+}
+
+/*
+ * MINPD/MAXPD return their second operand when either is NaN, so the
+ * accumulator goes second and NaN inputs leave it unchanged, matching
+ * the scalar SOA_SMIN/SOA_SMAX.
+ */
+#define SOA_MINMAX_AVX2(name, vop, sop, init) \
+	NOSHIRO_TARGET("avx2") \
+	static double name(const double *p, size_t n) \
+	{ \
+		__m256d a0 = _mm256_set1_pd(init), a1 = a0, a2 = a0, a3 = a0; \
+		size_t i = 0; \
+		for (; i + 16 <= n; i += 16) \
+		{ \
+			a0 = vop(_mm256_loadu_pd(p + i), a0); \
+			a1 = vop(_mm256_loadu_pd(p + i + 4), a1); \
+			a2 = vop(_mm256_loadu_pd(p + i + 8), a2); \
+			a3 = vop(_mm256_loadu_pd(p + i + 12), a3); \
+		} \
+		for (; i + 4 <= n; i += 4) \
+			a0 = vop(_mm256_loadu_pd(p + i), a0); \
+		a0 = vop(vop(a1, a0), vop(a3, a2)); \
+		double lanes[4]; \
+		_mm256_storeu_pd(lanes, a0); \
+		double m = lanes[0]; \
+		for (int k = 1; k < 4; k++) \
+			m = sop(m, lanes[k]); \
+		for (; i < n; i++) \
+			m = sop(m, p[i]); \
+		return m; \
+	}
+
+#define SOA_SMIN(a, b) ((b) < (a) ? (b) : (a))
+#define SOA_SMAX(a, b) ((b) > (a) ? (b) : (a))
+
+SOA_MINMAX_AVX2(soa_min_avx2, _mm256_min_pd, SOA_SMIN, INFINITY)
+SOA_MINMAX_AVX2(soa_max_avx2, _mm256_max_pd, SOA_SMAX, -INFINITY)
+
+#undef SOA_MINMAX_AVX2
+#undef SOA_SMIN
+#undef SOA_SMAX
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+#define SOA_DOUBLE_COLUMN(s, col, p, n) \
+	do \
+	{ \
+		if ((s) == NULL || (col) >= (s)->ncols || \
+		    ((const soa_t_real *)(s))->col_sizes[(col)] != \
+			sizeof(double)) \
+			return NAN; \
+		(p) = soa_column((s), const double, (col)); \
+		(n) = (s)->len; \
+	} while (0)
+
+double
+soa_sum_double(const soa_t *s, size_t col)
+{
+	const double *p;
+	size_t n;
+	SOA_DOUBLE_COLUMN(s, col, p, n);
+
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+		return soa_sum_avx2(p, n);
+#endif
+	return soa_sum_scalar(p, n);
+}
+
+double
+soa_min_double(const soa_t *s, size_t col)
+{
+	const double *p;
+	size_t n;
+	SOA_DOUBLE_COLUMN(s, col, p, n);
+
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+		return soa_min_avx2(p, n);
+#endif
+	return soa_min_scalar(p, n);
+}
+
+double
+soa_max_double(const soa_t *s, size_t col)
+{
+	const double *p;
+	size_t n;
+	SOA_DOUBLE_COLUMN(s, col, p, n);
+
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+		return soa_max_avx2(p, n);
+#endif
+	return soa_max_scalar(p, n);
+}
+
+#undef SOA_DOUBLE_COLUMN
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_SOA_H__
+#define __NOSHIRO_SOA_H__
+
+#include <stddef.h>
+
+#include "sda.h"
+
+/*
+ * Columnar (struct-of-arrays) container.
+ *
+ * Each field of a record lives in its own aligned sda_t column, and all
+ * columns always have the same length. Kernels that only read some fields
+ * stream through those columns with unit stride instead of skipping over
+ * the interleaved fields of an array of structs.
+ */
+typedef struct {
+	size_t len;
+	size_t ncols;
+	sda_t **cols;
+} soa_t;
+
+/**
+ * Create an empty container.
+ *
+ * @param ncols     number of columns
+ * @param col_sizes element size of each column
+ * @param alignment alignment of every column in bytes (power of two);
+ *                  0 selects 64, a cache line
+ * @return          the container, or NULL on failure
+ */
+soa_t *soa_new(size_t ncols, const size_t *col_sizes, size_t alignment);
+
+void soa_free(soa_t *s);
+
+/**
+ * Resize all columns to @p length rows; new rows are zeroed.
+ */
+soa_t *soa_set_size(soa_t *s, size_t length);
+
+/**
+ * Append @p count records from an array of structs (AoS -> SoA).
+ *
+ * @param s       container
+ * @param records first record
+ * @param count   number of records
+ * @param stride  distance between records in bytes, usually sizeof(record)
+ * @param offsets offset of each column's field inside a record; NULL means
+ *                the fields are packed in column order
+ * @return        @p s, or NULL on failure
+ */
+soa_t *soa_append_aos(soa_t *s,
+		      const void *records,
+		      size_t count,
+		      size_t stride,
+		      const size_t *offsets);
+
+/**
+ * Copy rows [start, start + count) out to an array of structs
+ * (SoA -> AoS). Arguments mirror soa_append_aos(). Rows past the end of
+ * the container are not written.
+ */
+void soa_to_aos(const soa_t *s,
+		size_t start,
+		size_t count,
+		void *records,
+		size_t stride,
+		const size_t *offsets);
+
+/*
+ * Reductions over a column of doubles. The AVX2 kernel is picked at
+ * runtime; it sums in several independent lanes, so the result of
+ * soa_sum_double() may differ from a sequential sum in the last bits.
+ * NaN values are not propagated by min and max. An empty column gives 0,
+ * +INFINITY and -INFINITY respectively.
+ */
+double soa_sum_double(const soa_t *s, size_t col);
+double soa_min_double(const soa_t *s, size_t col);
+double soa_max_double(const soa_t *s, size_t col);
+
+/* Column view: a plain, aligned pointer to the first element */
+#define soa_column(s, t, c)   ((t *)(void *)(s)->cols[(c)]->data)
+#define soa_index(s, t, c, i) (soa_column((s), t, (c))[(i)])
+
+#endif /* __NOSHIRO_SOA_H__ */
@@ -0,0 +1,131 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "stats.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/* Counters of one thread; never freed so counts outlive their thread */
+typedef struct stats_block {
+	struct stats_block *next;
+	_Atomic uint64_t values[NOSHIRO_STAT_COUNT];
+} stats_block;
+
+_Atomic int noshiro_stats_active;
+
+static stats_block *stats_blocks;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local stats_block *stats_local;
+
+static const char *stats_names[NOSHIRO_STAT_COUNT] = {
+    [NOSHIRO_STAT_ALLOCS] = "allocs",
+    [NOSHIRO_STAT_ALLOC_BYTES] = "alloc_bytes",
+    [NOSHIRO_STAT_REALLOCS] = "reallocs",
+    [NOSHIRO_STAT_REALLOC_BYTES] = "realloc_bytes",
+    [NOSHIRO_STAT_MOVE_BYTES] = "move_bytes",
+    [NOSHIRO_STAT_COPY_BYTES] = "copy_bytes",
+    [NOSHIRO_STAT_SEARCHES] = "searches",
+    [NOSHIRO_STAT_HASHES] = "hashes",
+    [NOSHIRO_STAT_HASH_BYTES] = "hash_bytes",
+};
+
+void
+noshiro_stats_enable(bool on)
+{
+	atomic_store_explicit(&noshiro_stats_active, on, memory_order_relaxed);
+}
+
+static stats_block *
+stats_block_get(void)
+{
+	if (stats_local != NULL)
+		return stats_local;
+
+	stats_block *b = (stats_block *)calloc(1, sizeof(stats_block));
+	if (b == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&stats_lock);
+	b->next = stats_blocks;
+	stats_blocks = b;
+	pthread_mutex_unlock(&stats_lock);
+
+	stats_local = b;
+	return b;
+}
+
+void
+noshiro_stats_add(noshiro_stat_t stat, uint64_t n)
+{
+	stats_block *b = stats_block_get();
+	if (b == NULL || (unsigned)stat >= NOSHIRO_STAT_COUNT)
+		return;
+
+	/* Only this thread writes the block: a plain load and store will do */
+	_Atomic uint64_t *v = &b->values[stat];
+	atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + n,
+			      memory_order_relaxed);
+}
+
+void
+noshiro_stats_snapshot(noshiro_stats_t *out)
+{
+	for (int i = 0; i < NOSHIRO_STAT_COUNT; i++)
+		out->values[i] = 0;
+
+	pthread_mutex_lock(&stats_lock);
+	for (stats_block *b = stats_blocks; b != NULL; b = b->next)
+	{
+		for (int i = 0; i < NOSHIRO_STAT_COUNT; i++)
+			out->values[i] += atomic_load_explicit(&b->values[i], memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+void
+noshiro_stats_reset(void)
+{
+	pthread_mutex_lock(&stats_lock);
+	for (stats_block *b = stats_blocks; b != NULL; b = b->next)
+	{
+		for (int i = 0; i < NOSHIRO_STAT_COUNT; i++)
+			atomic_store_explicit(&b->values[i], 0, memory_order_relaxed);
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+const char *
+noshiro_stat_name(noshiro_stat_t stat)
+{
+	return (unsigned)stat < NOSHIRO_STAT_COUNT ? stats_names[stat] : NULL;
+}
+
+void
+noshiro_stats_log(void)
+{
+	noshiro_stats_t s;
+	noshiro_stats_snapshot(&s);
+
+	for (int i = 0; i < NOSHIRO_STAT_COUNT; i++)
+		lwnotice("noshiro stats: %s=%llu", stats_names[i], (unsigned long long)s.values[i]);
+}
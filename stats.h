@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_STATS_H__
+#define __NOSHIRO_STATS_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Operation and allocation counters.
+ *
+ * Counting is off by default; while it is off, a counting point in the
+ * library costs one relaxed load and a branch. While it is on, every thread
+ * bumps its own counters without atomic read-modify-writes, and
+ * noshiro_stats_snapshot() sums them over all threads. Define
+ * NOSHIRO_NO_STATS to compile the counting points out.
+ */
+typedef enum
+{
+	NOSHIRO_STAT_ALLOCS,        ///< malloc-family calls
+	NOSHIRO_STAT_ALLOC_BYTES,   ///< bytes requested by them
+	NOSHIRO_STAT_REALLOCS,      ///< buffers grown in place or moved
+	NOSHIRO_STAT_REALLOC_BYTES, ///< new sizes requested by them
+	NOSHIRO_STAT_MOVE_BYTES,    ///< bytes shifted by memmove within a buffer
+	NOSHIRO_STAT_COPY_BYTES,    ///< bytes copied into new buffers
+	NOSHIRO_STAT_SEARCHES,      ///< substring and key searches
+	NOSHIRO_STAT_HASHES,        ///< hash or digest computations
+	NOSHIRO_STAT_HASH_BYTES,    ///< bytes hashed
+	NOSHIRO_STAT_COUNT
+} noshiro_stat_t;
+
+typedef struct {
+	uint64_t values[NOSHIRO_STAT_COUNT];
+} noshiro_stats_t;
+
+/* Non-zero while counting; read through the macros */
+extern _Atomic int noshiro_stats_active;
+
+void noshiro_stats_enable(bool on);
+
+/* Sum of the counters of every thread that ever counted */
+void noshiro_stats_snapshot(noshiro_stats_t *out);
+
+/* Zero all counters. Counts made concurrently may survive. */
+void noshiro_stats_reset(void);
+
+const char *noshiro_stat_name(noshiro_stat_t stat);
+
+/* Write a snapshot through lwnotice(), one counter per line */
+void noshiro_stats_log(void);
+
+/* Add to a counter of the calling thread; use NOSHIRO_STAT_ADD() */
+void noshiro_stats_add(noshiro_stat_t stat, uint64_t n);
+
+#ifndef NOSHIRO_NO_STATS
+#define NOSHIRO_STAT_ADD(stat, n) \
+	do \
+	{ \
+		if (atomic_load_explicit(&noshiro_stats_active, memory_order_relaxed)) \
+			noshiro_stats_add((stat), (uint64_t)(n)); \
+	} while (0)
+#else
+#define NOSHIRO_STAT_ADD(stat, n) ((void)0)
+#endif
+
+#define NOSHIRO_STAT_INC(stat) NOSHIRO_STAT_ADD(stat, 1)
+
+/* One allocation of `bytes` */
+#define NOSHIRO_STAT_ALLOC(bytes) \
+	do \
+	{ \
+		NOSHIRO_STAT_INC(NOSHIRO_STAT_ALLOCS); \
+		NOSHIRO_STAT_ADD(NOSHIRO_STAT_ALLOC_BYTES, (bytes)); \
+	} while (0)
+
+#endif /* __NOSHIRO_STATS_H__ */
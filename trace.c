@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define TRACE_DEFAULT_EVENTS 65536
+
+typedef struct {
+	const char *name;
+	uint64_t start;
+	uint64_t dur;
+	uint64_t arg;
+} trace_event;
+
+/* One per thread that ever recorded an event; never freed so an export
+ * can read the events of threads that have exited */
+typedef struct trace_buffer {
+	struct trace_buffer *next;
+	long tid;
+	size_t capacity;
+	_Atomic size_t count;
+	trace_event events[];
+} trace_buffer;
+
+_Atomic int trace_active;
+
+static size_t trace_capacity = TRACE_DEFAULT_EVENTS;
+static trace_buffer *trace_buffers;
+static _Atomic uint64_t trace_lost;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local trace_buffer *trace_local;
+
+static long
+trace_thread_id(void)
+{
+#ifdef __linux__
+	return (long)syscall(SYS_gettid);
+#else
+	return (long)(uintptr_t)pthread_self();
+#endif
+}
+
+void
+trace_start(size_t events_per_thread)
+{
+	pthread_mutex_lock(&trace_lock);
+	trace_capacity = events_per_thread ? events_per_thread : TRACE_DEFAULT_EVENTS;
+	pthread_mutex_unlock(&trace_lock);
+	atomic_store_explicit(&trace_active, 1, memory_order_relaxed);
+}
+
+void
+trace_stop(void)
+{
+	atomic_store_explicit(&trace_active, 0, memory_order_relaxed);
+}
+
+void
+trace_clear(void)
+{
+	pthread_mutex_lock(&trace_lock);
+	for (trace_buffer *b = trace_buffers; b != NULL; b = b->next)
+		atomic_store_explicit(&b->count, 0, memory_order_relaxed);
+	pthread_mutex_unlock(&trace_lock);
+	atomic_store_explicit(&trace_lost, 0, memory_order_relaxed);
+}
+
+uint64_t
+trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static trace_buffer *
+trace_buffer_get(void)
+{
+	if (trace_local != NULL)
+		return trace_local;
+
+	pthread_mutex_lock(&trace_lock);
+	size_t capacity = trace_capacity;
+	trace_buffer *b = (trace_buffer *)malloc(sizeof(trace_buffer) +
+						 capacity * sizeof(trace_event));
+	if (b != NULL)
+	{
+		b->tid = trace_thread_id();
+		b->capacity = capacity;
+		atomic_init(&b->count, 0);
+		b->next = trace_buffers;
+		trace_buffers = b;
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	trace_local = b;
+	return b;
+}
+
+void
+trace_record(const char *name, uint64_t start, uint64_t end, uint64_t arg)
+{
+	trace_buffer *b = trace_buffer_get();
+	if (b == NULL)
+	{
+		atomic_fetch_add_explicit(&trace_lost, 1, memory_order_relaxed);
+		return;
+	}
+
+	/* Only this thread appends, so the count needs no read-modify-write */
+	size_t n = atomic_load_explicit(&b->count, memory_order_relaxed);
+	if (n == b->capacity)
+	{
+		atomic_fetch_add_explicit(&trace_lost, 1, memory_order_relaxed);
+		return;
+	}
+
+	trace_event *e = &b->events[n];
+	e->name = name;
+	e->start = start;
+	e->dur = end - start;
+	e->arg = arg;
+	atomic_store_explicit(&b->count, n + 1, memory_order_release);
+}
+
+uint64_t
+trace_dropped(void)
+{
+	return atomic_load_explicit(&trace_lost, memory_order_relaxed);
+}
+
+static void
+trace_write_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++)
+	{
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+int
+trace_export_json(FILE *out)
+{
+	long pid = (long)getpid();
+	bool first = true;
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+
+	pthread_mutex_lock(&trace_lock);
+	for (trace_buffer *b = trace_buffers; b != NULL; b = b->next)
+	{
+		size_t n = atomic_load_explicit(&b->count, memory_order_acquire);
+		for (size_t i = 0; i < n; i++)
+		{
+			const trace_event *e = &b->events[i];
+
+			fputs(first ? "\n{\"name\":" : ",\n{\"name\":", out);
+			first = false;
+			trace_write_string(out, e->name);
+			/* Timestamps are in microseconds */
+			fprintf(out,
+				",\"cat\":\"noshiro\",\"ph\":\"X\",\"ts\":%llu.%03u,"
+				"\"dur\":%llu.%03u,\"pid\":%ld,\"tid\":%ld",
+				(unsigned long long)(e->start / 1000),
+				(unsigned)(e->start % 1000),
+				(unsigned long long)(e->dur / 1000),
+				(unsigned)(e->dur % 1000),
+				pid,
+				b->tid);
+			if (e->arg != TRACE_NO_ARG)
+				fprintf(out, ",\"args\":{\"n\":%llu}", (unsigned long long)e->arg);
+			fputc('}', out);
+		}
+	}
+	pthread_mutex_unlock(&trace_lock);
+
+	fputs("\n]}\n", out);
+	return ferror(out) ? -1 : 0;
+}
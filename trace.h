@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2023-present Merlot.Rain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __NOSHIRO_TRACE_H__
+#define __NOSHIRO_TRACE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Trace spans.
+ *
+ * TRACE_BEGIN()/TRACE_END() bracket an operation. While tracing is off a
+ * span costs one relaxed load and a branch; while it is on, the end of a
+ * span appends one event to a buffer owned by the calling thread, without
+ * locks. trace_export_json() writes every recorded event in the Chrome
+ * trace-event format, which chrome://tracing and Perfetto load directly.
+ *
+ * Define NOSHIRO_NO_TRACE to compile the macros out.
+ */
+
+#define TRACE_NO_ARG UINT64_MAX
+
+typedef struct {
+	const char *name; ///< NULL when tracing was off at the start
+	uint64_t start;   ///< trace_now() at the start
+	uint64_t arg;     ///< size of the operation, or TRACE_NO_ARG
+} trace_span_t;
+
+/* Non-zero while tracing; read through the macros */
+extern _Atomic int trace_active;
+
+/**
+ * Start recording.
+ *
+ * @param events_per_thread capacity of each thread's buffer (0 for the
+ *                          default of 65536); events past it are dropped.
+ *                          Buffers already allocated keep their size.
+ */
+void trace_start(size_t events_per_thread);
+
+/* Stop recording; the events stay available for export */
+void trace_stop(void);
+
+/* Discard the recorded events. Call only while no span is being ended. */
+void trace_clear(void);
+
+/* Monotonic timestamp in nanoseconds */
+uint64_t trace_now(void);
+
+/* Append a complete event to the calling thread's buffer */
+void trace_record(const char *name, uint64_t start, uint64_t end, uint64_t arg);
+
+/**
+ * Write all recorded events as Chrome trace-event JSON.
+ *
+ * @return 0 on success, -1 on a write error
+ */
+int trace_export_json(FILE *out);
+
+/* Number of events dropped because a thread's buffer was full */
+uint64_t trace_dropped(void);
+
+static inline trace_span_t
+trace_span_begin(const char *name, uint64_t arg)
+{
+	trace_span_t span = {NULL, 0, arg};
+	if (atomic_load_explicit(&trace_active, memory_order_relaxed))
+	{
+		span.name = name;
+		span.start = trace_now();
+	}
+	return span;
+}
+
+static inline void
+trace_span_end(const trace_span_t *span)
+{
+	if (span->name != NULL)
+		trace_record(span->name, span->start, trace_now(), span->arg);
+}
+
+#ifndef NOSHIRO_NO_TRACE
+/* Open span `var` named `name`; TRACE_BEGIN_N also records a size */
+#define TRACE_BEGIN(var, name)      trace_span_t var = trace_span_begin((name), TRACE_NO_ARG)
+#define TRACE_BEGIN_N(var, name, n) trace_span_t var = trace_span_begin((name), (uint64_t)(n))
+#define TRACE_END(var)              trace_span_end(&(var))
+#else
+#define TRACE_BEGIN(var, name)      ((void)0)
+#define TRACE_BEGIN_N(var, name, n) ((void)0)
+#define TRACE_END(var)              ((void)0)
+#endif
+
+#endif /* __NOSHIRO_TRACE_H__ */
@@ -20,82 +20,356 @@
  * IN THE SOFTWARE.
  */
 
-#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/random.h>
+#endif
 
 #include "uuid.h"
+#include "cpu.h"
+#include "md5.h"
+#include "sha.h"
+#include "trace.h"
 
-int
-uuid_parse(const char *in, UUID uu)
+#ifdef NOSHIRO_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+/* Hex value of every byte, -1 for non hex digits */
+static const int8_t uuid_hexval[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static const char hexdigits_lower[16] = "0123456789abcdef";
+
+/* Offset of the first hex digit of every UUID byte in the text form */
+static const uint8_t uuid_text_pos[16] = {
+    0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34,
+};
+
+static int
+uuid_parse_scalar(const char *in, UUID uu)
 {
-	if (strlen(in) != 36)
+	int bad;
+
+	bad = (in[8] != '-') | (in[13] != '-') | (in[18] != '-') | (in[23] != '-');
+	for (int i = 0; i < 16; i++)
+	{
+		int hi = uuid_hexval[(uint8_t)in[uuid_text_pos[i]]];
+		int lo = uuid_hexval[(uint8_t)in[uuid_text_pos[i] + 1]];
+
+		/* Both are -1 for invalid digits, so a sign bit flags an error */
+		bad |= (hi | lo) < 0;
+		uu[i] = (uint8_t)((unsigned)hi << 4 | (unsigned)lo);
+	}
+
+	return bad ? -1 : 0;
+}
+
+static void
+uuid_unparse_scalar(const UUID uu, char *out)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		out[uuid_text_pos[i]] = hexdigits_lower[uu[i] >> 4];
+		out[uuid_text_pos[i] + 1] = hexdigits_lower[uu[i] & 15];
+	}
+	out[8] = out[13] = out[18] = out[23] = '-';
+}
+
+#ifdef NOSHIRO_X86_DISPATCH
+
+/*
+ * The 32 hex digits of a UUID are gathered into two 16-byte halves with
+ * pshufb: bytes 0..7 come from text offsets 0..17, bytes 8..15 from
+ * offsets 19..35. Each half needs two overlapping sources, merged with an
+ * OR since pshufb zeroes lanes whose index has the top bit set.
+ */
+#define Z (char)0x80
+#define UUID_GATHER_LO_A \
+	0, 1, 2, 3, 4, 5, 6, 7, 9, 10, 11, 12, 14, 15, Z, Z /* in + 0 */
+#define UUID_GATHER_LO_B \
+	Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, 12, 13 /* in + 4 */
+#define UUID_GATHER_HI_A \
+	Z, 0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 /* in + 20 */
+#define UUID_GATHER_HI_B \
+	3, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z /* in + 16 */
+
+/* Text offsets 8, 13 and 18, 23 as seen from the loads at in and in + 16 */
+#define UUID_HYPHEN_MASK ((1u << 8) | (1u << 13) | (1u << 18) | (1u << 23))
+
+/*
+ * Converts 16 ASCII hex digits to nibble values and returns them with a
+ * mask that has a lane set for every invalid character.
+ */
+NOSHIRO_TARGET("ssse3")
+static inline __m128i
+uuid_hex_decode_ssse3(__m128i c, __m128i *invalid)
+{
+	__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+				 _mm_set1_epi8('a'));
+	/* Unsigned x <= k is min(x, k) == x */
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+	__m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	*invalid = _mm_or_si128(*invalid,
+				_mm_xor_si128(_mm_or_si128(is_digit, is_alpha),
+					      _mm_set1_epi8(-1)));
+	return _mm_or_si128(
+	    _mm_and_si128(is_digit, d),
+	    _mm_andnot_si128(is_digit, _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+NOSHIRO_TARGET("ssse3")
+static int
+uuid_parse_ssse3(const char *in, UUID uu)
+{
+	__m128i a0 = _mm_loadu_si128((const __m128i *)(const void *)in);
+	__m128i a1 = _mm_loadu_si128((const __m128i *)(const void *)(in + 4));
+	__m128i b0 = _mm_loadu_si128((const __m128i *)(const void *)(in + 16));
+	__m128i b1 = _mm_loadu_si128((const __m128i *)(const void *)(in + 20));
+	__m128i hyphen = _mm_set1_epi8('-');
+	unsigned hyphens =
+	    (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a0, hyphen)) |
+	    (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b0, hyphen)) << 16;
+
+	__m128i lo = _mm_or_si128(
+	    _mm_shuffle_epi8(a0, _mm_setr_epi8(UUID_GATHER_LO_A)),
+	    _mm_shuffle_epi8(a1, _mm_setr_epi8(UUID_GATHER_LO_B)));
+	__m128i hi = _mm_or_si128(
+	    _mm_shuffle_epi8(b1, _mm_setr_epi8(UUID_GATHER_HI_A)),
+	    _mm_shuffle_epi8(b0, _mm_setr_epi8(UUID_GATHER_HI_B)));
+
+	__m128i invalid = _mm_setzero_si128();
+	lo = uuid_hex_decode_ssse3(lo, &invalid);
+	hi = uuid_hex_decode_ssse3(hi, &invalid);
+
+	if (_mm_movemask_epi8(invalid) != 0 || hyphens != UUID_HYPHEN_MASK)
 		return -1;
 
-	return uuid_parse_range(in, in + 36, uu);
+	/* (hi nibble * 16 + lo nibble) per byte pair, then narrow */
+	__m128i weights = _mm_set1_epi16(0x0110);
+	__m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(lo, weights),
+					 _mm_maddubs_epi16(hi, weights));
+	_mm_storeu_si128((__m128i *)(void *)uu, bytes);
+	return 0;
 }
 
+/*
+ * Same gather as the SSSE3 kernel, with both halves in one register: the
+ * low lane reads text offsets 0..15 and 4..19, the high lane 20..35 and
+ * 16..31, so two 32-byte loads cover the input exactly.
+ */
+NOSHIRO_TARGET("avx2")
 static int
-xdigit_to_int(char c)
+uuid_parse_avx2(const char *in, UUID uu)
 {
-	c = tolower(c);
+	__m256i v = _mm256_loadu_si256((const __m256i *)(const void *)in);
+	__m256i t = _mm256_loadu_si256((const __m256i *)(const void *)(in + 4));
+	unsigned hyphens = (unsigned)_mm256_movemask_epi8(
+	    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
 
-	if (c >= 'a' && c <= 'f')
-		return c - 'a' + 10;
+	__m256i src_a = _mm256_blend_epi32(v, t, 0xf0);
+	__m256i src_b = _mm256_blend_epi32(t, v, 0xf0);
+	__m256i c = _mm256_or_si256(
+	    _mm256_shuffle_epi8(src_a, _mm256_setr_epi8(UUID_GATHER_LO_A,
+							UUID_GATHER_HI_A)),
+	    _mm256_shuffle_epi8(src_b, _mm256_setr_epi8(UUID_GATHER_LO_B,
+							UUID_GATHER_HI_B)));
 
-	if (c >= '0' && c <= '9')
-		return c - '0';
+	__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)),
+				    _mm256_set1_epi8('a'));
+	__m256i is_digit =
+	    _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(9)), d);
+	__m256i is_alpha =
+	    _mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(5)), l);
 
-	return -1;
+	if ((unsigned)_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha)) !=
+		0xffffffffu ||
+	    hyphens != UUID_HYPHEN_MASK)
+		return -1;
+
+	__m256i nibbles = _mm256_blendv_epi8(
+	    _mm256_add_epi8(l, _mm256_set1_epi8(10)), d, is_digit);
+	__m256i words = _mm256_maddubs_epi16(nibbles, _mm256_set1_epi16(0x0110));
+	__m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words),
+					 _mm256_extracti128_si256(words, 1));
+	_mm_storeu_si128((__m128i *)(void *)uu, bytes);
+	return 0;
 }
 
-int
-uuid_parse_range(const char *in_start, const char *in_end, UUID uu)
+/*
+ * The inverse of the parse gather: hex digits of bytes 0..7 (lo) and
+ * 8..15 (hi) are scattered to text offsets 0..15, 16..31 and 32..35, and
+ * the hyphens are ORed into the zeroed lanes.
+ */
+#define UUID_SCATTER_0_LO 0, 1, 2, 3, 4, 5, 6, 7, Z, 8, 9, 10, 11, Z, 12, 13
+#define UUID_SCATTER_1_LO 14, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z
+#define UUID_SCATTER_1_HI Z, Z, Z, 0, 1, 2, 3, Z, 4, 5, 6, 7, 8, 9, 10, 11
+
+NOSHIRO_TARGET("ssse3")
+static inline void
+uuid_unparse_store_ssse3(__m128i v, char *out)
 {
-	int i;
-	const char *cp;
+	const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+					     '7', '8', '9', 'a', 'b', 'c', 'd',
+					     'e', 'f');
+	__m128i mask = _mm_set1_epi8(0x0f);
+	__m128i hi_nib = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+	__m128i lo_nib = _mm_and_si128(v, mask);
+	__m128i lo = _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(hi_nib, lo_nib));
+	__m128i hi = _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(hi_nib, lo_nib));
 
-	if ((in_end - in_start) != 36)
+	__m128i o0 = _mm_or_si128(
+	    _mm_shuffle_epi8(lo, _mm_setr_epi8(UUID_SCATTER_0_LO)),
+	    _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, '-', 0, 0, 0, 0, '-', 0, 0));
+	__m128i o1 = _mm_or_si128(
+	    _mm_or_si128(_mm_shuffle_epi8(lo, _mm_setr_epi8(UUID_SCATTER_1_LO)),
+			 _mm_shuffle_epi8(hi, _mm_setr_epi8(UUID_SCATTER_1_HI))),
+	    _mm_setr_epi8(0, 0, '-', 0, 0, 0, 0, '-', 0, 0, 0, 0, 0, 0, 0, 0));
+	uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(hi, 12));
+
+	_mm_storeu_si128((__m128i *)(void *)out, o0);
+	_mm_storeu_si128((__m128i *)(void *)(out + 16), o1);
+	memcpy(out + 32, &tail, 4);
+}
+
+NOSHIRO_TARGET("ssse3")
+static void
+uuid_unparse_ssse3(const UUID uu, char *out)
+{
+	uuid_unparse_store_ssse3(_mm_loadu_si128((const __m128i *)(const void *)uu),
+				 out);
+}
+
+#undef Z
+
+#endif /* NOSHIRO_X86_DISPATCH */
+
+/* Parses exactly 36 characters at in */
+static inline int
+uuid_parse36(const char *in, UUID uu)
+{
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+		return uuid_parse_avx2(in, uu);
+	if (cpu_supports("ssse3"))
+		return uuid_parse_ssse3(in, uu);
+#endif
+	return uuid_parse_scalar(in, uu);
+}
+
+int
+uuid_parse(const char *in, UUID uu)
+{
+	if (strlen(in) != 36)
 		return -1;
 
-	for (i = 0, cp = in_start; i < 16; i++)
-	{
-		int hi;
-		int lo;
+	return uuid_parse36(in, uu);
+}
 
-		if (i == 4 || i == 6 || i == 8 || i == 10)
-			cp++;
+int
+uuid_parse_range(const char *in_start, const char *in_end, UUID uu)
+{
+	if ((in_end - in_start) != 36)
+		return -1;
 
-		hi = xdigit_to_int(*cp++);
-		lo = xdigit_to_int(*cp++);
+	return uuid_parse36(in_start, uu);
+}
 
-		if (hi == -1 || lo == -1)
-			return -1;
+size_t
+uuid_parse_many(const char *in, size_t n, size_t stride, UUID *uus)
+{
+	size_t i = 0;
+	TRACE_BEGIN_N(span, "uuid_parse_many", n);
 
-		uu[i] = (hi << 4) + lo;
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("avx2"))
+	{
+		for (; i < n; i++)
+			if (uuid_parse_avx2(in + i * stride, uus[i]) != 0)
+				break;
+	}
+	else if (cpu_supports("ssse3"))
+	{
+		for (; i < n; i++)
+			if (uuid_parse_ssse3(in + i * stride, uus[i]) != 0)
+				break;
+	}
+	else
+#endif
+	{
+		for (; i < n; i++)
+			if (uuid_parse_scalar(in + i * stride, uus[i]) != 0)
+				break;
 	}
 
-	return 0;
+	TRACE_END(span);
+	return i;
 }
 
-static const char hexdigits_lower[16] = "0123456789abcdef";
-
 void
 uuid_unparse(const UUID uuid, char *out)
 {
-	char *p = out;
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("ssse3"))
+		uuid_unparse_ssse3(uuid, out);
+	else
+#endif
+		uuid_unparse_scalar(uuid, out);
 
-	for (int i = 0; i < 16; i++)
-	{
-		uint8_t tmp;
+	out[36] = '\0';
+}
 
-		if (i == 4 || i == 6 || i == 8 || i == 10)
-			*p++ = '-';
+void
+uuid_unparse_many(const UUID *uus, size_t n, char *out, char sep)
+{
+	TRACE_BEGIN_N(span, "uuid_unparse_many", n);
 
-		tmp = uuid[i];
-		*p++ = hexdigits_lower[tmp >> 4];
-		*p++ = hexdigits_lower[tmp & 15];
+#ifdef NOSHIRO_X86_DISPATCH
+	if (cpu_supports("ssse3"))
+	{
+		for (size_t i = 0; i < n; i++, out += 37)
+		{
+			uuid_unparse_ssse3(uus[i], out);
+			out[36] = sep;
+		}
+	}
+	else
+#endif
+	{
+		for (size_t i = 0; i < n; i++, out += 37)
+		{
+			uuid_unparse_scalar(uus[i], out);
+			out[36] = sep;
+		}
 	}
 
-	*p = '\0';
+	TRACE_END(span);
 }
 
 int
@@ -123,4 +397,448 @@ void
 uuid_nil(UUID uu)
 {
 	memset(uu, 0, UUID_LEN);
-}
\ No newline at end of file
+}
+/* ---------------------------- generation ---------------------------- */
+
+/*
+ * Per-thread ChaCha20 generator with fast key erasure: every refill runs
+ * four blocks under the current key, takes the first 32 bytes as the next
+ * key and hands out the other 224, wiping them as they are consumed.
+ */
+#define UUID_RNG_BLOCKS 4
+#define UUID_RNG_BYTES  (UUID_RNG_BLOCKS * 64 - 32)
+
+typedef struct {
+	uint32_t key[8];
+	uint8_t buf[UUID_RNG_BYTES];
+	size_t pos; /* next unused byte of buf */
+	unsigned generation;
+	bool seeded;
+} uuid_rng;
+
+typedef struct {
+	uint64_t ms;      /* timestamp of the last v7 UUID */
+	uint64_t counter; /* its 42-bit counter */
+} uuid_v7_state;
+
+static _Thread_local uuid_rng uuid_rng_local;
+static _Thread_local uuid_v7_state uuid_v7_local;
+
+/* Bumped in the child after fork() so every generator reseeds */
+static _Atomic unsigned uuid_fork_generation;
+static pthread_once_t uuid_atfork_once = PTHREAD_ONCE_INIT;
+
+static void
+uuid_atfork_child(void)
+{
+	atomic_fetch_add_explicit(&uuid_fork_generation, 1, memory_order_relaxed);
+}
+
+static void
+uuid_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, uuid_atfork_child);
+}
+
+#define UUID_ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define UUID_QR(a, b, c, d) \
+	do \
+	{ \
+		a += b; \
+		d ^= a; \
+		d = UUID_ROTL32(d, 16); \
+		c += d; \
+		b ^= c; \
+		b = UUID_ROTL32(b, 12); \
+		a += b; \
+		d ^= a; \
+		d = UUID_ROTL32(d, 8); \
+		c += d; \
+		b ^= c; \
+		b = UUID_ROTL32(b, 7); \
+	} while (0)
+
+static void
+uuid_chacha20_block(const uint32_t key[8], uint32_t counter, uint8_t out[64])
+{
+	uint32_t in[16] = {
+	    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+	    key[0], key[1], key[2], key[3],
+	    key[4], key[5], key[6], key[7],
+	    counter, 0, 0, 0,
+	};
+	uint32_t x[16];
+
+	memcpy(x, in, sizeof(x));
+	for (int i = 0; i < 10; i++)
+	{
+		UUID_QR(x[0], x[4], x[8], x[12]);
+		UUID_QR(x[1], x[5], x[9], x[13]);
+		UUID_QR(x[2], x[6], x[10], x[14]);
+		UUID_QR(x[3], x[7], x[11], x[15]);
+		UUID_QR(x[0], x[5], x[10], x[15]);
+		UUID_QR(x[1], x[6], x[11], x[12]);
+		UUID_QR(x[2], x[7], x[8], x[13]);
+		UUID_QR(x[3], x[4], x[9], x[14]);
+	}
+	for (int i = 0; i < 16; i++)
+	{
+		uint32_t v = x[i] + in[i];
+		out[i * 4] = (uint8_t)v;
+		out[i * 4 + 1] = (uint8_t)(v >> 8);
+		out[i * 4 + 2] = (uint8_t)(v >> 16);
+		out[i * 4 + 3] = (uint8_t)(v >> 24);
+	}
+}
+
+static void
+uuid_os_random(void *buf, size_t len)
+{
+	uint8_t *p = (uint8_t *)buf;
+
+#ifdef __linux__
+	while (len > 0)
+	{
+		ssize_t n = getrandom(p, len, 0);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+#endif
+	if (len > 0)
+	{
+		int fd = open("/dev/urandom", O_RDONLY);
+		while (fd >= 0 && len > 0)
+		{
+			ssize_t n = read(fd, p, len);
+			if (n <= 0)
+			{
+				if (n < 0 && errno == EINTR)
+					continue;
+				break;
+			}
+			p += n;
+			len -= (size_t)n;
+		}
+		if (fd >= 0)
+			close(fd);
+	}
+	/* Predictable UUIDs are worse than none */
+	if (len > 0)
+		abort();
+}
+
+static void
+uuid_rng_refill(uuid_rng *rng)
+{
+	uint8_t out[UUID_RNG_BLOCKS * 64];
+
+	for (uint32_t i = 0; i < UUID_RNG_BLOCKS; i++)
+		uuid_chacha20_block(rng->key, i, out + i * 64);
+
+	for (int i = 0; i < 8; i++)
+		rng->key[i] = (uint32_t)out[i * 4] | (uint32_t)out[i * 4 + 1] << 8 |
+			      (uint32_t)out[i * 4 + 2] << 16 | (uint32_t)out[i * 4 + 3] << 24;
+	memcpy(rng->buf, out + 32, UUID_RNG_BYTES);
+	memset(out, 0, sizeof(out));
+	rng->pos = 0;
+}
+
+static uuid_rng *
+uuid_rng_get(void)
+{
+	uuid_rng *rng = &uuid_rng_local;
+	unsigned generation = atomic_load_explicit(&uuid_fork_generation, memory_order_relaxed);
+
+	if (!rng->seeded || rng->generation != generation)
+	{
+		pthread_once(&uuid_atfork_once, uuid_atfork_register);
+		uuid_os_random(rng->key, sizeof(rng->key));
+		rng->generation = generation;
+		rng->seeded = true;
+		uuid_rng_refill(rng);
+	}
+	return rng;
+}
+
+static void
+uuid_random_bytes(void *out, size_t len)
+{
+	uuid_rng *rng = uuid_rng_get();
+	uint8_t *p = (uint8_t *)out;
+
+	while (len > 0)
+	{
+		if (rng->pos == UUID_RNG_BYTES)
+			uuid_rng_refill(rng);
+
+		size_t n = UUID_RNG_BYTES - rng->pos;
+		if (n > len)
+			n = len;
+		memcpy(p, rng->buf + rng->pos, n);
+		memset(rng->buf + rng->pos, 0, n);
+		rng->pos += n;
+		p += n;
+		len -= n;
+	}
+}
+
+static inline void
+uuid_set_version(UUID uu, int version)
+{
+	uu[6] = (uint8_t)((uu[6] & 0x0f) | version << 4);
+	uu[8] = (uint8_t)((uu[8] & 0x3f) | 0x80); /* RFC 4122 variant */
+}
+
+void
+uuid_generate_v4(UUID uu)
+{
+	uuid_random_bytes(uu, UUID_LEN);
+	uuid_set_version(uu, 4);
+}
+
+void
+uuid_generate_v4_many(UUID *uus, size_t n)
+{
+	uuid_random_bytes(uus, n * UUID_LEN);
+	for (size_t i = 0; i < n; i++)
+		uuid_set_version(uus[i], 4);
+}
+
+#define UUID_V7_COUNTER_BITS 42
+#define UUID_V7_COUNTER_MAX  (((uint64_t)1 << UUID_V7_COUNTER_BITS) - 1)
+
+static uint64_t
+uuid_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*
+ * Layout: 48-bit ms timestamp, version, counter bits 41..30 (rand_a),
+ * variant, counter bits 29..0 and 32 random bits (rand_b).
+ */
+static void
+uuid_v7_fill(UUID uu, uint64_t ms, uint64_t counter, const uint8_t rnd[4])
+{
+	uu[0] = (uint8_t)(ms >> 40);
+	uu[1] = (uint8_t)(ms >> 32);
+	uu[2] = (uint8_t)(ms >> 24);
+	uu[3] = (uint8_t)(ms >> 16);
+	uu[4] = (uint8_t)(ms >> 8);
+	uu[5] = (uint8_t)ms;
+	uu[6] = (uint8_t)(0x70 | ((counter >> 38) & 0x0f));
+	uu[7] = (uint8_t)(counter >> 30);
+	uu[8] = (uint8_t)(0x80 | ((counter >> 24) & 0x3f));
+	uu[9] = (uint8_t)(counter >> 16);
+	uu[10] = (uint8_t)(counter >> 8);
+	uu[11] = (uint8_t)counter;
+	memcpy(uu + 12, rnd, 4);
+}
+
+/* Next (ms, counter) pair of the calling thread */
+static void
+uuid_v7_next(uuid_v7_state *st, uint64_t now, uint64_t *ms, uint64_t *counter)
+{
+	if (now > st->ms)
+	{
+		/* A new millisecond: random start with the top bit clear, so
+		 * the counter has at least 2^41 steps left */
+		uint64_t r;
+		uuid_random_bytes(&r, sizeof(r));
+		st->ms = now;
+		st->counter = r & (UUID_V7_COUNTER_MAX >> 1);
+	}
+	else if (st->counter == UUID_V7_COUNTER_MAX)
+	{
+		/* Exhausted (or the clock went back): borrow the next ms */
+		st->ms++;
+		st->counter = 0;
+	}
+	else
+	{
+		st->counter++;
+	}
+	*ms = st->ms;
+	*counter = st->counter;
+}
+
+void
+uuid_generate_v7(UUID uu)
+{
+	uint64_t ms, counter;
+	uint8_t rnd[4];
+
+	uuid_v7_next(&uuid_v7_local, uuid_now_ms(), &ms, &counter);
+	uuid_random_bytes(rnd, sizeof(rnd));
+	uuid_v7_fill(uu, ms, counter, rnd);
+}
+
+void
+uuid_generate_v7_many(UUID *uus, size_t n)
+{
+	uint64_t now = uuid_now_ms();
+
+	/* Draw all random tails at once into the last 4n bytes of the
+	 * output; UUID i only overwrites the tails of UUIDs before it */
+	uint8_t *tails = (uint8_t *)uus + n * (UUID_LEN - 4);
+	uuid_random_bytes(tails, n * 4);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t ms, counter;
+		uint8_t rnd[4];
+
+		memcpy(rnd, tails + i * 4, 4);
+		uuid_v7_next(&uuid_v7_local, now, &ms, &counter);
+		uuid_v7_fill(uus[i], ms, counter, rnd);
+	}
+}
+
+/* ---------------------------- name-based ---------------------------- */
+
+const UUID uuid_ns_dns = {0x6b, 0xa7, 0xb8, 0x10, 0x9d, 0xad, 0x11, 0xd1,
+			  0x80, 0xb4, 0x00, 0xc0, 0x4f, 0xd4, 0x30, 0xc8};
+const UUID uuid_ns_url = {0x6b, 0xa7, 0xb8, 0x11, 0x9d, 0xad, 0x11, 0xd1,
+			  0x80, 0xb4, 0x00, 0xc0, 0x4f, 0xd4, 0x30, 0xc8};
+const UUID uuid_ns_oid = {0x6b, 0xa7, 0xb8, 0x12, 0x9d, 0xad, 0x11, 0xd1,
+			  0x80, 0xb4, 0x00, 0xc0, 0x4f, 0xd4, 0x30, 0xc8};
+const UUID uuid_ns_x500 = {0x6b, 0xa7, 0xb8, 0x14, 0x9d, 0xad, 0x11, 0xd1,
+			   0x80, 0xb4, 0x00, 0xc0, 0x4f, 0xd4, 0x30, 0xc8};
+
+/*
+ * The batch versions hash the name space once and start every name from
+ * a copy of that context.
+ */
+static void
+uuid_v3_from(UUID uu, const md5_t *prefix, const char *name, size_t len)
+{
+	md5_t ctx = *prefix;
+	uint8_t digest[16];
+
+	md5_update(&ctx, (const uint8_t *)name, len);
+	md5_final(&ctx, digest);
+	memcpy(uu, digest, UUID_LEN);
+	uuid_set_version(uu, 3);
+}
+
+static void
+uuid_v5_from(UUID uu, const sha1_t *prefix, const char *name, size_t len)
+{
+	sha1_t ctx = *prefix;
+	uint8_t digest[SHA1_DIGEST_LEN];
+
+	sha1_update(&ctx, (const uint8_t *)name, len);
+	sha1_final(&ctx, digest);
+	memcpy(uu, digest, UUID_LEN);
+	uuid_set_version(uu, 5);
+}
+
+void
+uuid_generate_v3(UUID uu, const UUID ns, const char *name, size_t len)
+{
+	md5_t prefix;
+
+	md5_init(&prefix);
+	md5_update(&prefix, ns, UUID_LEN);
+	uuid_v3_from(uu, &prefix, name, len);
+}
+
+void
+uuid_generate_v5(UUID uu, const UUID ns, const char *name, size_t len)
+{
+	sha1_t prefix;
+
+	sha1_init(&prefix);
+	sha1_update(&prefix, ns, UUID_LEN);
+	uuid_v5_from(uu, &prefix, name, len);
+}
+
+/* Names hashed per md5_sum_many() call by uuid_generate_v3_many() */
+#define UUID_V3_BATCH 256
+
+void
+uuid_generate_v3_many(UUID *uus, const UUID ns, const char *const *names,
+		      const size_t *lens, size_t n)
+{
+	const uint8_t *msgs[UUID_V3_BATCH];
+	size_t msg_lens[UUID_V3_BATCH];
+	uint8_t digests[UUID_V3_BATCH * 16];
+	uint8_t *buf = NULL;
+	size_t cap = 0, done = 0;
+	TRACE_BEGIN_N(span, "uuid_generate_v3_many", n);
+
+	/*
+	 * md5_sum_many() hashes whole messages, so every name is copied
+	 * behind the name space into a scratch buffer, a batch at a time.
+	 */
+	while (done < n)
+	{
+		size_t count = n - done < UUID_V3_BATCH ? n - done : UUID_V3_BATCH;
+		size_t need = 0;
+
+		for (size_t i = 0; i < count; i++)
+			need += UUID_LEN + lens[done + i];
+		if (need > cap)
+		{
+			uint8_t *grown = realloc(buf, need);
+			if (!grown)
+				break;
+			buf = grown;
+			cap = need;
+		}
+
+		uint8_t *p = buf;
+		for (size_t i = 0; i < count; i++)
+		{
+			msgs[i] = p;
+			msg_lens[i] = UUID_LEN + lens[done + i];
+			memcpy(p, ns, UUID_LEN);
+			memcpy(p + UUID_LEN, names[done + i], lens[done + i]);
+			p += msg_lens[i];
+		}
+		md5_sum_many(digests, msgs, msg_lens, count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			memcpy(uus[done + i], digests + i * 16, UUID_LEN);
+			uuid_set_version(uus[done + i], 3);
+		}
+		done += count;
+	}
+	free(buf);
+
+	/* Out of memory: hash the rest one by one */
+	if (done < n)
+	{
+		md5_t prefix;
+
+		md5_init(&prefix);
+		md5_update(&prefix, ns, UUID_LEN);
+		for (size_t i = done; i < n; i++)
+			uuid_v3_from(uus[i], &prefix, names[i], lens[i]);
+	}
+
+	TRACE_END(span);
+}
+
+void
+uuid_generate_v5_many(UUID *uus, const UUID ns, const char *const *names,
+		      const size_t *lens, size_t n)
+{
+	sha1_t prefix;
+	TRACE_BEGIN_N(span, "uuid_generate_v5_many", n);
+
+	sha1_init(&prefix);
+	sha1_update(&prefix, ns, UUID_LEN);
+	for (size_t i = 0; i < n; i++)
+		uuid_v5_from(uus[i], &prefix, names[i], lens[i]);
+
+	TRACE_END(span);
+}
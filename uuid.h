@@ -23,6 +23,7 @@
 #ifndef __NOSHIRO_UUID_H__
 #define __NOSHIRO_UUID_H__
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -96,6 +97,88 @@ int uuid_parse_range(const char *in_start, const char *in_end, UUID uu);
  */
 void uuid_unparse(const UUID uu, char *out);
 
+/**
+ * Parses n UUID strings laid out at a fixed distance from each other, such
+ * as the rows of a fixed-width export or an array of C strings. The i-th
+ * string starts at `in + i * stride` and is exactly 36 characters; the
+ * bytes between strings are not examined. Hyphens must be in their
+ * canonical positions; hex digits may be of either case.
+ *
+ * @param[in]  in     First string
+ * @param[in]  n      Number of strings
+ * @param[in]  stride Distance between the starts of two strings, at least 36
+ * @param[out] uus    Array of n UUIDs
+ * @return            n on success, otherwise the index of the first invalid
+ *                    string; the UUIDs before it have been parsed.
+ */
+size_t uuid_parse_many(const char *in, size_t n, size_t stride, UUID *uus);
+
+/**
+ * Serializes n UUIDs into a contiguous buffer of 37 * n characters: every
+ * UUID in the lowercase form of uuid_unparse() followed by sep, e.g. '\n'
+ * for one UUID per line or '\0' for an array of C strings.
+ *
+ * @param[in]  uus  Array of n UUIDs
+ * @param[in]  n    Number of UUIDs
+ * @param[out] out  Buffer of no less than 37 * n characters
+ * @param[in]  sep  Character written after every UUID
+ */
+void uuid_unparse_many(const UUID *uus, size_t n, char *out, char sep);
+
+/* Name space UUIDs of IETF RFC 4122 Appendix C */
+extern const UUID uuid_ns_dns;
+extern const UUID uuid_ns_url;
+extern const UUID uuid_ns_oid;
+extern const UUID uuid_ns_x500;
+
+/**
+ * Generates a name-based (version 3) UUID: the MD5 digest of the name
+ * space UUID followed by the name. The same name space and name always
+ * give the same UUID.
+ *
+ * @param[out] uu   UUID
+ * @param[in]  ns   Name space UUID, e.g. uuid_ns_dns
+ * @param[in]  name Name, not necessarily NUL terminated
+ * @param[in]  len  Length of name in bytes
+ */
+void uuid_generate_v3(UUID uu, const UUID ns, const char *name, size_t len);
+
+/**
+ * Generates a name-based (version 5) UUID from the SHA-1 digest of the
+ * name space UUID followed by the name. Prefer it over version 3 unless
+ * compatibility requires MD5.
+ *
+ * @param[out] uu   UUID
+ * @param[in]  ns   Name space UUID, e.g. uuid_ns_dns
+ * @param[in]  name Name, not necessarily NUL terminated
+ * @param[in]  len  Length of name in bytes
+ */
+void uuid_generate_v5(UUID uu, const UUID ns, const char *name, size_t len);
+
+/**
+ * Generates n version 3 UUIDs for names in one name space.
+ *
+ * @param[out] uus   Array of n UUIDs
+ * @param[in]  ns    Name space UUID
+ * @param[in]  names Array of n names
+ * @param[in]  lens  Array of the n name lengths in bytes
+ * @param[in]  n     Number of names
+ */
+void uuid_generate_v3_many(UUID *uus, const UUID ns, const char *const *names,
+			   const size_t *lens, size_t n);
+
+/**
+ * Generates n version 5 UUIDs for names in one name space.
+ *
+ * @param[out] uus   Array of n UUIDs
+ * @param[in]  ns    Name space UUID
+ * @param[in]  names Array of n names
+ * @param[in]  lens  Array of the n name lengths in bytes
+ * @param[in]  n     Number of names
+ */
+void uuid_generate_v5_many(UUID *uus, const UUID ns, const char *const *names,
+			   const size_t *lens, size_t n);
+
 /**
  * Compares two UUIDs for equality.
  *
@@ -121,4 +204,46 @@ void uuid_copy(UUID dest, const UUID src);
  */
 void uuid_nil(UUID uu);
 
+/**
+ * Generates a random (version 4) UUID.
+ *
+ * The bits come from a ChaCha20 generator private to the calling thread,
+ * seeded from the kernel (getrandom) and reseeded in the child after
+ * fork(). Each refill rekeys the generator and used output is wiped, so
+ * earlier UUIDs cannot be recovered from its state.
+ *
+ * @param[out] uu  UUID
+ */
+void uuid_generate_v4(UUID uu);
+
+/**
+ * Generates n random (version 4) UUIDs at once.
+ *
+ * @param[out] uus  Array of n UUIDs
+ * @param[in]  n    Number of UUIDs to generate
+ */
+void uuid_generate_v4_many(UUID *uus, size_t n);
+
+/**
+ * Generates a time-ordered (version 7) UUID: a 48-bit Unix timestamp in
+ * milliseconds followed by a 42-bit counter and 32 random bits.
+ *
+ * UUIDs generated by one thread are strictly increasing, also when several
+ * fall in the same millisecond or the clock steps back; the counter starts
+ * at a random value each millisecond and carries into the timestamp when
+ * it overflows. No locks are taken; UUIDs of different threads are only
+ * ordered by their millisecond.
+ *
+ * @param[out] uu  UUID
+ */
+void uuid_generate_v7(UUID uu);
+
+/**
+ * Generates n increasing time-ordered (version 7) UUIDs at once.
+ *
+ * @param[out] uus  Array of n UUIDs
+ * @param[in]  n    Number of UUIDs to generate
+ */
+void uuid_generate_v7_many(UUID *uus, size_t n);
+
 #endif /* __NOSHIRO_UUID_H__ */
\ No newline at end of file